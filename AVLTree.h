@@ -1,22 +1,51 @@
 ﻿#pragma once
+#include "Allocator.h"
+#include "Augment.h"
 #include "ITree.h"
+#include "Snapshot.h"
+#include "StaticSearchTree.h"
+#include "ThreadPool.h"
+#include "TreeStats.h"
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+template<typename T, typename Allocator = std::allocator<T>, typename Stats = NullStats, typename Augment = NoAugment<T>>
+class AVLTree : public ITree<T> {
+public:
+    using aggregate_type = typename Augment::value_type;
 
-template<typename T>
-class AVLTree {
 private:
     struct Node {
         T data;
         Node* left;
         Node* right;
         int height;
-        Node(T val) : data(val), left(nullptr), right(nullptr), height(1) {}
+        std::size_t size;
+        [[no_unique_address]] aggregate_type agg;
+        Node(T val, aggregate_type a) : data(val), left(nullptr), right(nullptr), height(1), size(1), agg(a) {}
     };
 
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
     Node* root;
+    NodeAllocator alloc;
+    [[no_unique_address]] Augment augment;
+    [[no_unique_address]] mutable Stats stats;
 
+    Node* createNode(const T& key);
+    void destroyNode(Node* node);
+    void clear(Node* node);
     int height(Node* node);
     int balanceFactor(Node* node);
+    static std::size_t size(Node* node);
+    aggregate_type aggregate(Node* node) const;
+    void update(Node* node);
+    Node* rebalance(Node* node);
     Node* rotateRight(Node* y);
     Node* rotateLeft(Node* x);
     Node* insert(Node* node, T key);
@@ -24,91 +53,241 @@ private:
     Node* remove(Node* node, const T& key);
     Node* minValueNode(Node* node);
 
+    // узлы, начиная с которых set-операции делятся между потоками
+    static constexpr std::size_t parallelCutoff = 4096;
+
+    Node* joinRight(Node* l, Node* m, Node* r);
+    Node* joinLeft(Node* l, Node* m, Node* r);
+    Node* join(Node* l, Node* m, Node* r);
+    Node* join2(Node* l, Node* r);
+    Node* removeMax(Node* node, Node*& max);
+    Node* split(Node* node, const T& key, Node*& left, Node*& right);
+    // узлы, освобождаемые set-операциями: освобождаются потом, в
+    // вызывающем потоке, чтобы аллокатор не вызывался из пула
+    using Garbage = std::vector<Node*>;
+    // pool == nullptr - всё в текущем потоке
+    Node* unite(Node* a, Node* b, ThreadPool* pool, Garbage& dead);
+    Node* intersect(Node* a, Node* b, ThreadPool* pool, Garbage& dead);
+    Node* difference(Node* a, Node* b, ThreadPool* pool, Garbage& dead);
+    void release(Garbage& dead);
+    Node* clone(Node* node);
+    Node* build(const T* keys, std::size_t n);
+    Node* build(SnapshotReader& in, std::size_t n, bool& ok);
+    bool restore(SnapshotReader& in);
+    template<typename F>
+    void visit(Node* node, F& f) const;
+    Node* adopt(Node* nodes, AVLTree& owner);
+    int verify(Node* node, const T* lo, const T* hi) const;
+
 public:
     AVLTree() : root(nullptr) {};
-    void insert(const T& value);
-    void remove(const T& value);
-    bool search(const T& value) const;
-    void print() const;
+    explicit AVLTree(const Allocator& allocator) : root(nullptr), alloc(allocator) {};
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
+    ~AVLTree() { clear(root); }
+    void insert(const T& value) override;
+    void remove(const T& value) override;
+    bool search(const T& value) const override;
+    void print() const override;
+
+    std::size_t size() const;
+    // число элементов меньше value
+    std::size_t rank(const T& value) const;
+    // k-й по возрастанию элемент (с нуля) или nullptr
+    const T* select(std::size_t k) const;
+    // число элементов в [lo, hi]
+    std::size_t count_range(const T& lo, const T& hi) const;
+    // свёртка Augment по элементам [lo, hi] в порядке возрастания
+    aggregate_type aggregate(const T& lo, const T& hi) const;
+
+    // Присоединяет other справа; все его ключи должны быть больше наших.
+    // other становится пустым.
+    void join(AVLTree& other);
+    // Переносит ключи больше key в right (его прежнее содержимое удаляется)
+    void split(const T& key, AVLTree& right);
+
+    // Объединение, пересечение и разность с other за O(m log(n/m + 1)).
+    // Узлы other переиспользуются, other становится пустым. Независимые
+    // поддеревья обрабатываются параллельно в pool. Аллокатор вызывается
+    // только из текущего потока, а хуки Stats (повороты, сравнения) - и из
+    // потоков пула, так что Stats должен быть потокобезопасным, как
+    // NullStats и CountingStats.
+    void unite_with(AVLTree& other, ThreadPool& pool = ThreadPool::global());
+    void intersect_with(AVLTree& other, ThreadPool& pool = ThreadPool::global());
+    void difference_with(AVLTree& other, ThreadPool& pool = ThreadPool::global());
+
+    // Вставляет ключи [first, last) одним слиянием: пакет сортируется,
+    // собирается в сбалансированное дерево и объединяется с нашим через
+    // split/join, так что баланс восстанавливается один раз на пакет,
+    // а не на каждый ключ. Слияние идёт в текущем потоке; с pool большие
+    // пакеты (от parallelCutoff узлов) сливаются параллельно.
+    template<typename InputIt>
+    void insert_batch(InputIt first, InputIt last, ThreadPool* pool = nullptr);
+    // Для каждого ключа из [first, last) пишет в found, есть ли он в дереве.
+    // Поиск начинается от места предыдущего ключа (finger search), поэтому
+    // близкие ключи находятся почти за O(1).
+    template<typename InputIt, typename OutputIt>
+    OutputIt find_batch(InputIt first, InputIt last, OutputIt found) const;
+
+    // Снимок дерева (см. Snapshot.h). load собирает идеально
+    // сбалансированное дерево за O(n) без сравнений и поворотов; при ошибке
+    // возвращает false и оставляет дерево как было. load(path) читает файл
+    // через mmap.
+    bool save(std::ostream& out) const;
+    bool save(const std::string& path) const;
+    bool load(std::istream& in);
+    bool load(const std::string& path);
+
+    // Неизменяемая копия для дерева, которое больше не меняется
+    StaticSearchTree<T> freeze() const;
+
+    const Stats& getStats() const { return stats; }
+    // память узлов: выделенные байты и из них выравнивание
+    MemoryFootprint memory_footprint() const;
+    // Проверяет инварианты: ключи строго по возрастанию, высоты и размеры
+    // узлов верны, баланс каждого узла в пределах ±1. Для тестов и отладки.
+    bool verify() const;
 };
 
-template<typename T>
-int AVLTree<T>::height(Node* node) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::createNode(const T& key) {
+    Node* node = NodeTraits::allocate(alloc, 1);
+    NodeTraits::construct(alloc, node, key, augment.lift(key));
+    stats.allocation();
+    return node;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::destroyNode(Node* node) {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
+    stats.deallocation();
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::clear(Node* node) {
+    // арена освобождает всю память разом
+    if constexpr (isArenaAllocator<Allocator> && std::is_trivially_destructible_v<T>)
+        return;
+
+    if (!node) return;
+    clear(node->left);
+    clear(node->right);
+    destroyNode(node);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+int AVLTree<T, Allocator, Stats, Augment>::height(Node* node) {
     return node ? node->height : 0;
 }
 
-template<typename T>
-int AVLTree<T>::balanceFactor(Node* node) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+int AVLTree<T, Allocator, Stats, Augment>::balanceFactor(Node* node) {
     return node ? height(node->left) - height(node->right) : 0;
 }
 
-template<typename T>
-typename AVLTree<T>::Node* AVLTree<T>::rotateRight(Node* y) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+std::size_t AVLTree<T, Allocator, Stats, Augment>::size(Node* node) {
+    return node ? node->size : 0;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::aggregate_type AVLTree<T, Allocator, Stats, Augment>::aggregate(Node* node) const {
+    return node ? node->agg : augment.identity();
+}
+
+// Пересчитывает высоту, размер и агрегат узла по его детям
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::update(Node* node) {
+    node->height = 1 + std::max(height(node->left), height(node->right));
+    node->size = 1 + size(node->left) + size(node->right);
+    node->agg = augment.combine(augment.combine(aggregate(node->left), augment.lift(node->data)), aggregate(node->right));
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::rotateRight(Node* y) {
     Node* x = y->left;
     y->left = x->right;
     x->right = y;
+    stats.rotation();
 
-    y->height = std::max(height(y->left), height(y->right)) + 1;
-    x->height = std::max(height(x->left), height(x->right)) + 1;
+    update(y);
+    update(x);
 
     return x;
 }
 
-template<typename T>
-typename AVLTree<T>::Node* AVLTree<T>::rotateLeft(Node* x) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::rotateLeft(Node* x) {
     Node* y = x->right;
     x->right = y->left;
     y->left = x;
+    stats.rotation();
 
-    x->height = std::max(height(x->left), height(x->right)) + 1;
-    y->height = std::max(height(y->left), height(y->right)) + 1;
+    update(x);
+    update(y);
 
     return y;
 }
 
-template<typename T>
-typename AVLTree<T>::Node* AVLTree<T>::insert(Node* node, T key) {
-    if (!node) return new Node(key);
-
-    if (key < node->data) node->left = insert(node->left, key);
-    else if (key > node->data) node->right = insert(node->right, key);
-    else return node;
-
-    node->height = 1 + std::max(height(node->left), height(node->right));
+// Обновляет узел и восстанавливает баланс, если высоты детей отличаются на 2
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::rebalance(Node* node) {
+    update(node);
 
     int balance = balanceFactor(node);
 
-    if (balance > 1 && key < node->left->data) return rotateRight(node);
-    if (balance < -1 && key > node->right->data) return rotateLeft(node);
-    if (balance > 1 && key > node->left->data) {
-        node->left = rotateLeft(node->left);
+    if (balance > 1) {
+        if (balanceFactor(node->left) < 0)
+            node->left = rotateLeft(node->left);
         return rotateRight(node);
     }
-    if (balance < -1 && key < node->right->data) {
-        node->right = rotateRight(node->right);
+    if (balance < -1) {
+        if (balanceFactor(node->right) > 0)
+            node->right = rotateRight(node->right);
         return rotateLeft(node);
     }
 
     return node;
 }
 
-template<typename T>
-void AVLTree<T>::insert(const T& value) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::insert(Node* node, T key) {
+    if (!node) return createNode(key);
+
+    stats.comparison();
+    if (key < node->data) node->left = insert(node->left, key);
+    else if (key > node->data) node->right = insert(node->right, key);
+    else return node;
+
+    return rebalance(node);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::insert(const T& value) {
     root = insert(root, value);
 }
 
-template<typename T>
-bool AVLTree<T>::search(const T& value) const {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::search(const T& value) const {
     Node* current = root;
+    int depth = 0;
+    bool found = false;
     while (current) {
-        if (value == current->data) return true;
+        depth++;
+        stats.comparison();
+        if (value == current->data) {
+            found = true;
+            break;
+        }
         current = (value < current->data) ? current->left : current->right;
     }
-    return false;
+    stats.depth(depth);
+    return found;
 }
 
-template<typename T>
-void AVLTree<T>::print(Node* node, const std::string& label, int indent) const {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::print(Node* node, const std::string& label, int indent) const {
     if (!node) return;
 
     std::cout << std::string(indent, ' ') << label << ": " << node->data << std::endl;
@@ -117,8 +296,8 @@ void AVLTree<T>::print(Node* node, const std::string& label, int indent) const {
     print(node->right, "R", indent + 4);
 }
 
-template<typename T>
-void AVLTree<T>::print() const {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::print() const {
     if (!root) {
         std::cout << "(пусто)" << std::endl;
         return;
@@ -129,19 +308,20 @@ void AVLTree<T>::print() const {
     print(root->right, "R", 4);
 }
 
-template<typename T>
-typename AVLTree<T>::Node* AVLTree<T>::minValueNode(Node* node) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::minValueNode(Node* node) {
     Node* current = node;
     while (current && current->left)
         current = current->left;
     return current;
 }
 
-template<typename T>
-typename AVLTree<T>::Node* AVLTree<T>::remove(Node* node, const T& key) {
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::remove(Node* node, const T& key) {
     if (!node) return nullptr;
 
     // Поиск ключа
+    stats.comparison();
     if (key < node->data) {
         node->left = remove(node->left, key);
     }
@@ -154,11 +334,11 @@ typename AVLTree<T>::Node* AVLTree<T>::remove(Node* node, const T& key) {
 
         if (!node->right) {
             Node* leftChild = node->left;
-            delete node;
+            destroyNode(node);
             return leftChild;
         }
         else if (!node->left) {
-            delete node;
+            destroyNode(node);
             return rightChild;
         }
         else {
@@ -172,31 +352,583 @@ typename AVLTree<T>::Node* AVLTree<T>::remove(Node* node, const T& key) {
 
     if (!node) return node;
 
-    node->height = 1 + std::max(height(node->left), height(node->right));
+    return rebalance(node);
+}
 
-    int balance = height(node->left) - height(node->right);
 
-    if (balance > 1 && height(node->left) >= height(node->right))
-        return rotateRight(node);
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::remove(const T& value) {
+    root = remove(root, value);
+}
 
-    if (balance > 1 && height(node->left) < height(node->right)) {
-        node->left = rotateLeft(node->left);
-        return rotateRight(node);
+// Выравнивание - всё, что в узле сверх ключа, ссылок, высоты, размера и агрегата
+template<typename T, typename Allocator, typename Stats, typename Augment>
+MemoryFootprint AVLTree<T, Allocator, Stats, Augment>::memory_footprint() const {
+    constexpr std::size_t payload = sizeof(T) + 2 * sizeof(Node*) + sizeof(int) + sizeof(std::size_t)
+        + (std::is_empty_v<aggregate_type> ? 0 : sizeof(aggregate_type));
+    std::size_t nodes = size(root);
+    return { nodes * sizeof(Node), nodes * (sizeof(Node) - payload) };
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+std::size_t AVLTree<T, Allocator, Stats, Augment>::size() const {
+    return size(root);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::verify() const {
+    return verify(root, nullptr, nullptr) >= 0;
+}
+
+// Высота поддерева, все ключи которого в (lo, hi), или -1, если оно
+// нарушает инварианты
+template<typename T, typename Allocator, typename Stats, typename Augment>
+int AVLTree<T, Allocator, Stats, Augment>::verify(Node* node, const T* lo, const T* hi) const {
+    if (!node)
+        return 0;
+    if ((lo && !(*lo < node->data)) || (hi && !(node->data < *hi)))
+        return -1;
+
+    int hl = verify(node->left, lo, &node->data);
+    int hr = verify(node->right, &node->data, hi);
+    if (hl < 0 || hr < 0 || hl - hr > 1 || hr - hl > 1)
+        return -1;
+    if (node->height != 1 + std::max(hl, hr) || node->size != 1 + size(node->left) + size(node->right))
+        return -1;
+    return node->height;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+std::size_t AVLTree<T, Allocator, Stats, Augment>::rank(const T& value) const {
+    std::size_t r = 0;
+    Node* current = root;
+    while (current) {
+        if (current->data < value) {
+            r += size(current->left) + 1;
+            current = current->right;
+        }
+        else {
+            current = current->left;
+        }
     }
+    return r;
+}
 
-    if (balance < -1 && height(node->right) >= height(node->left))
-        return rotateLeft(node);
+template<typename T, typename Allocator, typename Stats, typename Augment>
+const T* AVLTree<T, Allocator, Stats, Augment>::select(std::size_t k) const {
+    Node* current = root;
+    while (current) {
+        std::size_t leftSize = size(current->left);
+        if (k < leftSize) {
+            current = current->left;
+        }
+        else if (k == leftSize) {
+            return &current->data;
+        }
+        else {
+            k -= leftSize + 1;
+            current = current->right;
+        }
+    }
+    return nullptr;
+}
 
-    if (balance < -1 && height(node->right) < height(node->left)) {
-        node->right = rotateRight(node->right);
-        return rotateLeft(node);
+template<typename T, typename Allocator, typename Stats, typename Augment>
+std::size_t AVLTree<T, Allocator, Stats, Augment>::count_range(const T& lo, const T& hi) const {
+    if (hi < lo) return 0;
+
+    // элементы не больше hi
+    std::size_t upTo = 0;
+    Node* current = root;
+    while (current) {
+        if (hi < current->data) {
+            current = current->left;
+        }
+        else {
+            upTo += size(current->left) + 1;
+            current = current->right;
+        }
+    }
+    return upTo - rank(lo);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::aggregate_type AVLTree<T, Allocator, Stats, Augment>::aggregate(const T& lo, const T& hi) const {
+    // спуск до первого узла внутри диапазона
+    Node* top = root;
+    while (top && (top->data < lo || hi < top->data))
+        top = top->data < lo ? top->right : top->left;
+    if (!top) return augment.identity();
+
+    // левая граница: суффикс левого поддерева с ключами >= lo
+    aggregate_type left = augment.identity();
+    for (Node* node = top->left; node;) {
+        if (node->data < lo) {
+            node = node->right;
+        }
+        else {
+            left = augment.combine(augment.combine(augment.lift(node->data), aggregate(node->right)), left);
+            node = node->left;
+        }
+    }
+
+    // правая граница: префикс правого поддерева с ключами <= hi
+    aggregate_type right = augment.identity();
+    for (Node* node = top->right; node;) {
+        if (hi < node->data) {
+            node = node->left;
+        }
+        else {
+            right = augment.combine(right, augment.combine(aggregate(node->left), augment.lift(node->data)));
+            node = node->right;
+        }
+    }
+
+    return augment.combine(augment.combine(left, augment.lift(top->data)), right);
+}
+
+// Спускается по правому краю l до поддерева высоты не больше h(r) + 1
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::joinRight(Node* l, Node* m, Node* r) {
+    Node* c = l->right;
+    if (height(c) <= height(r) + 1) {
+        m->left = c;
+        m->right = r;
+        update(m);
+        if (height(m) <= height(l->left) + 1) {
+            l->right = m;
+            update(l);
+            return l;
+        }
+        l->right = rotateRight(m);
+        update(l);
+        return rotateLeft(l);
+    }
+
+    l->right = joinRight(c, m, r);
+    update(l);
+    if (height(l->right) <= height(l->left) + 1)
+        return l;
+    return rotateLeft(l);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::joinLeft(Node* l, Node* m, Node* r) {
+    Node* c = r->left;
+    if (height(c) <= height(l) + 1) {
+        m->left = l;
+        m->right = c;
+        update(m);
+        if (height(m) <= height(r->right) + 1) {
+            r->left = m;
+            update(r);
+            return r;
+        }
+        r->left = rotateLeft(m);
+        update(r);
+        return rotateRight(r);
     }
 
+    r->left = joinLeft(l, m, c);
+    update(r);
+    if (height(r->left) <= height(r->right) + 1)
+        return r;
+    return rotateRight(r);
+}
+
+// Собирает l, узел m и r (l < m < r) в одно AVL-дерево за O(|h(l) - h(r)|)
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::join(Node* l, Node* m, Node* r) {
+    if (height(l) > height(r) + 1) return joinRight(l, m, r);
+    if (height(r) > height(l) + 1) return joinLeft(l, m, r);
+
+    m->left = l;
+    m->right = r;
+    update(m);
+    return m;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::removeMax(Node* node, Node*& max) {
+    if (!node->right) {
+        max = node;
+        return node->left;
+    }
+    node->right = removeMax(node->right, max);
+    return rebalance(node);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::join2(Node* l, Node* r) {
+    if (!l) return r;
+    Node* max = nullptr;
+    l = removeMax(l, max);
+    return join(l, max, r);
+}
+
+// Делит node на ключи меньше и больше key. Возвращает отцепленный узел
+// с ключом key или nullptr.
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::split(Node* node, const T& key, Node*& left, Node*& right) {
+    if (!node) {
+        left = right = nullptr;
+        return nullptr;
+    }
+
+    Node* l = node->left;
+    Node* r = node->right;
+    Node* found;
+    if (key < node->data) {
+        Node* middle;
+        found = split(l, key, left, middle);
+        right = join(middle, node, r);
+    }
+    else if (node->data < key) {
+        Node* middle;
+        found = split(r, key, middle, right);
+        left = join(l, node, middle);
+    }
+    else {
+        left = l;
+        right = r;
+        node->left = node->right = nullptr;
+        update(node);
+        found = node;
+    }
+    return found;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::unite(Node* a, Node* b, ThreadPool* pool, Garbage& dead) {
+    if (!a) return b;
+    if (!b) return a;
+
+    Node* l2;
+    Node* r2;
+    Node* duplicate = split(b, a->data, l2, r2);
+    if (duplicate) dead.push_back(duplicate);
+
+    Node* l = a->left;
+    Node* r = a->right;
+    if (pool && size(a) + size(l2) + size(r2) > parallelCutoff) {
+        Garbage deadRight;
+        pool->invoke([&] { l = unite(l, l2, pool, dead); },
+                     [&] { r = unite(r, r2, pool, deadRight); });
+        dead.insert(dead.end(), deadRight.begin(), deadRight.end());
+    }
+    else {
+        l = unite(l, l2, pool, dead);
+        r = unite(r, r2, pool, dead);
+    }
+    return join(l, a, r);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::intersect(Node* a, Node* b, ThreadPool* pool, Garbage& dead) {
+    if (!a || !b) {
+        if (a) dead.push_back(a);
+        if (b) dead.push_back(b);
+        return nullptr;
+    }
+
+    Node* l2;
+    Node* r2;
+    Node* found = split(b, a->data, l2, r2);
+
+    Node* l = a->left;
+    Node* r = a->right;
+    if (pool && size(a) + size(l2) + size(r2) > parallelCutoff) {
+        Garbage deadRight;
+        pool->invoke([&] { l = intersect(l, l2, pool, dead); },
+                     [&] { r = intersect(r, r2, pool, deadRight); });
+        dead.insert(dead.end(), deadRight.begin(), deadRight.end());
+    }
+    else {
+        l = intersect(l, l2, pool, dead);
+        r = intersect(r, r2, pool, dead);
+    }
+
+    if (found) {
+        dead.push_back(found);
+        return join(l, a, r);
+    }
+    a->left = a->right = nullptr;
+    dead.push_back(a);
+    return join2(l, r);
+}
+
+// a без ключей b
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::difference(Node* a, Node* b, ThreadPool* pool, Garbage& dead) {
+    if (!a || !b) {
+        if (b) dead.push_back(b);
+        return a;
+    }
+
+    Node* l1;
+    Node* r1;
+    Node* found = split(a, b->data, l1, r1);
+    if (found) dead.push_back(found);
+
+    Node* l = b->left;
+    Node* r = b->right;
+    if (pool && size(b) + size(l1) + size(r1) > parallelCutoff) {
+        Garbage deadRight;
+        pool->invoke([&] { l = difference(l1, l, pool, dead); },
+                     [&] { r = difference(r1, r, pool, deadRight); });
+        dead.insert(dead.end(), deadRight.begin(), deadRight.end());
+    }
+    else {
+        l = difference(l1, l, pool, dead);
+        r = difference(r1, r, pool, dead);
+    }
+
+    b->left = b->right = nullptr;
+    dead.push_back(b);
+    return join2(l, r);
+}
+
+// Освобождает поддеревья из dead
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::release(Garbage& dead) {
+    for (Node* node : dead)
+        clear(node);
+    dead.clear();
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::clone(Node* node) {
+    if (!node) return nullptr;
+
+    Node* copy = createNode(node->data);
+    copy->left = clone(node->left);
+    copy->right = clone(node->right);
+    update(copy);
+    return copy;
+}
+
+// Забирает узлы, выделенные аллокатором owner. Если аллокаторы
+// различаются, узлы копируются в свой, а оригиналы освобождаются.
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::adopt(Node* nodes, AVLTree& owner) {
+    if constexpr (!NodeTraits::is_always_equal::value) {
+        if (!(alloc == owner.alloc)) {
+            Node* copy = clone(nodes);
+            owner.clear(nodes);
+            return copy;
+        }
+    }
+    return nodes;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::join(AVLTree& other) {
+    if (&other == this) return;
+
+    Node* nodes = other.root;
+    other.root = nullptr;
+    root = join2(root, adopt(nodes, other));
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::split(const T& key, AVLTree& right) {
+    if (&right == this) return;
+
+    Node* l;
+    Node* r;
+    Node* found = split(root, key, l, r);
+    root = found ? join(l, found, nullptr) : l;
+
+    right.clear(right.root);
+    right.root = right.adopt(r, *this);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::unite_with(AVLTree& other, ThreadPool& pool) {
+    if (&other == this) return;
+
+    Node* nodes = other.root;
+    other.root = nullptr;
+    Garbage dead;
+    root = unite(root, adopt(nodes, other), &pool, dead);
+    release(dead);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::intersect_with(AVLTree& other, ThreadPool& pool) {
+    if (&other == this) return;
+
+    Node* nodes = other.root;
+    other.root = nullptr;
+    Garbage dead;
+    root = intersect(root, adopt(nodes, other), &pool, dead);
+    release(dead);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+void AVLTree<T, Allocator, Stats, Augment>::difference_with(AVLTree& other, ThreadPool& pool) {
+    if (&other == this) {
+        clear(root);
+        root = nullptr;
+        return;
+    }
+
+    Node* nodes = other.root;
+    other.root = nullptr;
+    Garbage dead;
+    root = difference(root, adopt(nodes, other), &pool, dead);
+    release(dead);
+}
+
+// Сбалансированное дерево из n упорядоченных различных ключей
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::build(const T* keys, std::size_t n) {
+    if (n == 0) return nullptr;
+
+    std::size_t mid = n / 2;
+    Node* node = createNode(keys[mid]);
+    node->left = build(keys, mid);
+    node->right = build(keys + mid + 1, n - mid - 1);
+    update(node);
     return node;
 }
 
+template<typename T, typename Allocator, typename Stats, typename Augment>
+template<typename InputIt>
+void AVLTree<T, Allocator, Stats, Augment>::insert_batch(InputIt first, InputIt last, ThreadPool* pool) {
+    std::vector<T> keys(first, last);
+    if (!std::is_sorted(keys.begin(), keys.end()))
+        std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // дубликаты уже имеющихся ключей unite освобождает сам
+    Garbage dead;
+    root = unite(root, build(keys.data(), keys.size()), pool, dead);
+    release(dead);
+}
+
+// path - путь от корня до узла, на котором остановился предыдущий поиск.
+// Перед спуском поднимаемся до ближайшего предка, в поддереве которого
+// может лежать key: для key больше предыдущего это узел, являющийся левым
+// сыном родителя с ключом больше key (для меньшего - зеркально).
+template<typename T, typename Allocator, typename Stats, typename Augment>
+template<typename InputIt, typename OutputIt>
+OutputIt AVLTree<T, Allocator, Stats, Augment>::find_batch(InputIt first, InputIt last, OutputIt found) const {
+    std::vector<Node*> path;
+    if (root) path.push_back(root);
+
+    for (; first != last; ++first, ++found) {
+        const T& key = *first;
+        if (path.empty()) {
+            *found = false;
+            continue;
+        }
 
-template<typename T>
-void AVLTree<T>::remove(const T& value) {
-    root = remove(root, value);
+        bool up = path.back()->data < key;
+        while (path.size() > 1) {
+            Node* node = path.back();
+            Node* parent = path[path.size() - 2];
+            stats.comparison();
+            if (up ? (node == parent->left && key < parent->data)
+                   : (node == parent->right && parent->data < key))
+                break;
+            path.pop_back();
+        }
+
+        bool hit = false;
+        for (Node* node = path.back(); node;) {
+            stats.comparison();
+            if (key == node->data) {
+                hit = true;
+                break;
+            }
+            node = (key < node->data) ? node->left : node->right;
+            if (node) path.push_back(node);
+        }
+        stats.depth(static_cast<int>(path.size()));
+        *found = hit;
+    }
+    return found;
+}
+
+// Обход по возрастанию
+template<typename T, typename Allocator, typename Stats, typename Augment>
+template<typename F>
+void AVLTree<T, Allocator, Stats, Augment>::visit(Node* node, F& f) const {
+    if (!node) return;
+    visit(node->left, f);
+    f(node->data);
+    visit(node->right, f);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::save(std::ostream& out) const {
+    return saveSnapshot<T>(out, size(root), [this](auto&& f) { visit(root, f); });
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    return out && save(out) && out.flush();
+}
+
+// Ключи идут в порядке возрастания, поэтому левое поддерево, корень и
+// правое поддерево читаются подряд
+template<typename T, typename Allocator, typename Stats, typename Augment>
+typename AVLTree<T, Allocator, Stats, Augment>::Node* AVLTree<T, Allocator, Stats, Augment>::build(SnapshotReader& in, std::size_t n, bool& ok) {
+    if (n == 0) return nullptr;
+
+    std::size_t mid = n / 2;
+    Node* left = build(in, mid, ok);
+    T key;
+    if (!ok || !SnapshotCodec<T>::read(in, key)) {
+        ok = false;
+        clear(left);
+        return nullptr;
+    }
+
+    Node* node = createNode(key);
+    node->left = left;
+    node->right = build(in, n - mid - 1, ok);
+    if (!ok) {
+        clear(node);
+        return nullptr;
+    }
+    update(node);
+    return node;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::restore(SnapshotReader& in) {
+    bool ok = true;
+    Node* nodes = build(in, static_cast<std::size_t>(in.count()), ok);
+    if (!ok || !in.finish()) {
+        clear(nodes);
+        return false;
+    }
+
+    clear(root);
+    root = nodes;
+    return true;
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::load(std::istream& in) {
+    SnapshotReader reader;
+    return reader.open(in, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+bool AVLTree<T, Allocator, Stats, Augment>::load(const std::string& path) {
+    SnapshotReader reader;
+    return reader.open(path, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats, typename Augment>
+StaticSearchTree<T> AVLTree<T, Allocator, Stats, Augment>::freeze() const {
+    std::vector<T> keys;
+    keys.reserve(size(root));
+    auto append = [&keys](const T& key) { keys.push_back(key); };
+    visit(root, append);
+    return StaticSearchTree<T>(std::move(keys));
 }
@@ -0,0 +1,255 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Free list of fixed-size blocks shared by every PoolAllocator whose value
+// type has the same size and alignment. Each thread keeps its own cache of
+// free blocks and only takes the global lock to refill or drain it in
+// batches. Slabs are kept for the lifetime of the process.
+template<std::size_t Size, std::size_t Align>
+class PoolStore {
+public:
+    static void* allocate() {
+        if (cacheGone())
+            return global().take();
+        Cache& cache = threadCache();
+        if (cache.head == nullptr)
+            global().refill(cache);
+        Block* block = cache.head;
+        cache.head = block->next;
+        cache.count--;
+        return block;
+    }
+
+    static void deallocate(void* p) {
+        Block* block = static_cast<Block*>(p);
+        if (cacheGone()) {
+            global().give(block);
+            return;
+        }
+        Cache& cache = threadCache();
+        block->next = cache.head;
+        cache.head = block;
+        if (++cache.count >= 2 * batch)
+            global().drain(cache, batch);
+    }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    static constexpr std::size_t align = Align > alignof(Block) ? Align : alignof(Block);
+    static constexpr std::size_t blockSize = ((Size > sizeof(Block) ? Size : sizeof(Block)) + align - 1) / align * align;
+    static constexpr std::size_t batch = 64;
+    static constexpr std::size_t slabBytes = 64 * 1024;
+
+    struct Cache {
+        Block* head = nullptr;
+        std::size_t count = 0;
+
+        ~Cache() {
+            if (count > 0)
+                global().drain(*this, count);
+            cacheGone() = true;
+        }
+    };
+
+    struct Global {
+        std::mutex lock;
+        Block* head = nullptr;
+
+        void refill(Cache& cache) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (head == nullptr)
+                grow();
+            for (std::size_t i = 0; i < batch && head != nullptr; i++) {
+                Block* block = head;
+                head = block->next;
+                block->next = cache.head;
+                cache.head = block;
+                cache.count++;
+            }
+        }
+
+        void drain(Cache& cache, std::size_t n) {
+            std::lock_guard<std::mutex> guard(lock);
+            for (std::size_t i = 0; i < n && cache.head != nullptr; i++) {
+                Block* block = cache.head;
+                cache.head = block->next;
+                cache.count--;
+                block->next = head;
+                head = block;
+            }
+        }
+
+        // Single blocks, for threads whose cache is already destroyed
+        Block* take() {
+            std::lock_guard<std::mutex> guard(lock);
+            if (head == nullptr)
+                grow();
+            Block* block = head;
+            head = block->next;
+            return block;
+        }
+
+        void give(Block* block) {
+            std::lock_guard<std::mutex> guard(lock);
+            block->next = head;
+            head = block;
+        }
+
+        void grow() {
+            std::size_t count = slabBytes / blockSize > batch ? slabBytes / blockSize : batch;
+            char* slab = static_cast<char*>(::operator new(count * blockSize, std::align_val_t(align)));
+            for (std::size_t i = count; i-- > 0;) {
+                Block* block = reinterpret_cast<Block*>(slab + i * blockSize);
+                block->next = head;
+                head = block;
+            }
+        }
+    };
+
+    // never destroyed, so trees with static storage duration can still
+    // release their nodes during program shutdown
+    static Global& global() {
+        static Global* g = new Global();
+        return *g;
+    }
+
+    static Cache& threadCache() {
+        thread_local Cache cache;
+        return cache;
+    }
+
+    // Thread-local objects are destroyed before statics, so a static tree
+    // freeing nodes at exit would otherwise touch this thread's dead cache.
+    // Trivially destructible, so it outlives the cache.
+    static bool& cacheGone() {
+        thread_local bool gone = false;
+        return gone;
+    }
+};
+
+// Stateless node allocator backed by PoolStore. Single-object requests
+// come from the pool; arrays fall back to operator new.
+template<typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    PoolAllocator() noexcept = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n == 1)
+            return static_cast<T*>(PoolStore<sizeof(T), alignof(T)>::allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if (n == 1)
+            PoolStore<sizeof(T), alignof(T)>::deallocate(p);
+        else
+            ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept { return false; }
+};
+
+// Bump-pointer region. Individual deallocations are ignored; everything is
+// released at once when the last ArenaAllocator referring to it goes away.
+// Not thread-safe.
+class Arena {
+public:
+    explicit Arena(std::size_t chunkBytes = 64 * 1024) : chunkSize(chunkBytes), cur(nullptr), end(nullptr), used(0), reserved(0) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    void* allocate(std::size_t bytes, std::size_t align) {
+        std::size_t pad = (align - reinterpret_cast<std::size_t>(cur) % align) % align;
+        if (cur == nullptr || pad + bytes > static_cast<std::size_t>(end - cur)) {
+            std::size_t size = bytes + align > chunkSize ? bytes + align : chunkSize;
+            chunks.push_back(static_cast<char*>(::operator new(size)));
+            reserved += size;
+            cur = chunks.back();
+            end = cur + size;
+            pad = (align - reinterpret_cast<std::size_t>(cur) % align) % align;
+        }
+        char* p = cur + pad;
+        cur = p + bytes;
+        used += bytes;
+        return p;
+    }
+
+    void release() {
+        for (char* chunk : chunks)
+            ::operator delete(chunk);
+        chunks.clear();
+        cur = end = nullptr;
+        used = 0;
+        reserved = 0;
+    }
+
+    std::size_t bytesUsed() const { return used; }
+    std::size_t bytesReserved() const { return reserved; }
+
+private:
+    std::size_t chunkSize;
+    std::vector<char*> chunks;
+    char* cur;
+    char* end;
+    std::size_t used;
+    std::size_t reserved;
+};
+
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator() : arena(std::make_shared<Arena>()) {}
+    explicit ArenaAllocator(std::shared_ptr<Arena> a) : arena(std::move(a)) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+    const std::shared_ptr<Arena>& region() const { return arena; }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+
+private:
+    template<typename U>
+    friend class ArenaAllocator;
+
+    std::shared_ptr<Arena> arena;
+};
+
+// Trees skip the per-node teardown walk when the allocator frees in bulk
+// and the stored values need no destructor.
+template<typename A>
+inline constexpr bool isArenaAllocator = false;
+
+template<typename T>
+inline constexpr bool isArenaAllocator<ArenaAllocator<T>> = true;
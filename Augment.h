@@ -0,0 +1,48 @@
+#pragma once
+#include <limits>
+
+// Augmentation policies for the balanced trees. An augmentation is a monoid
+// over the stored values: every node keeps the combination of its subtree,
+// so a range aggregate only needs O(log n) nodes.
+//
+//   value_type                          the aggregate kept in each node
+//   identity()                          neutral element
+//   lift(const T&)                      aggregate of a single value
+//   combine(const value_type&, ...)     associative, applied in key order
+
+// Keeps nothing; the aggregate field takes no space in the node.
+template<typename T>
+struct NoAugment {
+    struct value_type {};
+
+    static value_type identity() { return {}; }
+    static value_type lift(const T&) { return {}; }
+    static value_type combine(const value_type&, const value_type&) { return {}; }
+};
+
+template<typename T>
+struct SumAugment {
+    using value_type = T;
+
+    static value_type identity() { return T(); }
+    static value_type lift(const T& v) { return v; }
+    static value_type combine(const value_type& a, const value_type& b) { return a + b; }
+};
+
+template<typename T>
+struct MinAugment {
+    using value_type = T;
+
+    static value_type identity() { return std::numeric_limits<T>::max(); }
+    static value_type lift(const T& v) { return v; }
+    static value_type combine(const value_type& a, const value_type& b) { return b < a ? b : a; }
+};
+
+template<typename T>
+struct MaxAugment {
+    using value_type = T;
+
+    static value_type identity() { return std::numeric_limits<T>::lowest(); }
+    static value_type lift(const T& v) { return v; }
+    static value_type combine(const value_type& a, const value_type& b) { return a < b ? b : a; }
+};
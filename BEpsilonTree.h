@@ -0,0 +1,585 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ITree.h"
+#include "KeySearch.h"
+#include "StaticSearchTree.h"
+#include "TreeStats.h"
+
+// Write-optimized B-tree (B^epsilon-tree) for ingest-heavy workloads.
+// Updates are not applied where they belong but queued as messages
+// (insert or erase of a key): first in a sorted log a quarter of a buffer
+// long, then, the whole log at a time, in the buffer of the root. Every
+// inner node has such a buffer, sorted and holding at most one message per
+// key, the newest. When a buffer overflows, the run of messages bound for its
+// busiest child is moved down in one merge, and leaves apply whole runs
+// at once, so an update costs a few sequential moves per level instead
+// of a root-to-leaf walk, and a node is touched once per batch.
+//
+// A lookup checks the log and then each buffer on its way down, since the
+// newest message for a key decides; the first hit answers it. Buffers
+// and pivots are searched with KeySearch.
+//
+// Set semantics: inserting a present key or erasing an absent one is a
+// no-op. Nodes split when they overflow but are not merged on erase.
+template <typename T, typename Allocator = std::allocator<T>, typename Stats = NullStats>
+class BEpsilonTree : public ITree<T> {
+private:
+    enum Op : std::uint8_t {
+        Insert,
+        Erase
+    };
+
+    struct Node;
+
+    using KeyAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using OpAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint8_t>;
+    using IndexAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::uint32_t>;
+    using ChildAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node*>;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+    using Keys = std::vector<T, KeyAllocator>;
+    using Ops = std::vector<std::uint8_t, OpAllocator>;
+
+    struct Node {
+        bool leaf;
+        // leaf: the keys; inner: pivots, child i holding [pivots[i - 1], pivots[i])
+        Keys keys;
+        std::vector<Node*, ChildAllocator> children;
+        // inner: buffered messages, sorted by key; those for child i are
+        // pending[starts[i], starts[i + 1])
+        Keys pending;
+        Ops ops;
+        std::vector<std::uint32_t, IndexAllocator> starts;
+
+        Node(bool isLeaf, const Allocator& a) : leaf(isLeaf), keys(a), children(a), pending(a), ops(a), starts(a) {}
+    };
+
+    // nodes a split added right of the node it came from, with their pivots
+    struct Split {
+        Keys pivots;
+        std::vector<Node*, ChildAllocator> nodes;
+
+        explicit Split(const Allocator& a) : pivots(a), nodes(a) {}
+    };
+
+    // a run this many times shorter than what it merges into is placed by
+    // searches rather than walked through
+    static constexpr std::size_t sparseRatio = 16;
+
+    Node* root;
+    std::size_t fanout;
+    std::size_t bufferCapacity;
+    std::size_t leafCapacity;
+    // messages not yet in the root's buffer, sorted, newest per key
+    std::size_t logCapacity;
+    Keys logKeys;
+    Ops logOps;
+    // merge targets, swapped with the merged-into vectors to reuse capacity
+    Keys scratchLeaf;
+    Keys scratchKeys;
+    Ops scratchOps;
+    Allocator alloc;
+    NodeAllocator nodeAlloc;
+    [[no_unique_address]] mutable Stats stats;
+
+    Node* createNode(bool leaf);
+    void destroyNode(Node* node);
+    void clear(Node* node);
+
+    void log(const T& k, Op op);
+    void flushLog();
+    void deliver(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, Split& out);
+    void drain(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, Split& out);
+    static std::size_t seek(const T* keys, std::size_t n, const T& k, std::size_t gap);
+    void merge(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n);
+    void apply(Node* leaf, const T* keys, const std::uint8_t* ops, std::size_t n);
+    void flushChild(Node* node);
+    void splitLeaf(Node* leaf, Split& out);
+    void splitInner(Node* node, Split& out);
+    void grow(Split& out);
+    void collect(const Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, std::vector<T>& out) const;
+    void printRecursive(const Node* node, int indent) const;
+    void footprint(const Node* node, MemoryFootprint& total) const;
+
+public:
+    // fanout: children per inner node; bufferCapacity: messages an inner
+    // node buffers before flushing; leafCapacity: keys per leaf
+    explicit BEpsilonTree(int fanout = 32, int bufferCapacity = 1024, int leafCapacity = 1024, const Allocator& allocator = Allocator());
+    BEpsilonTree(const BEpsilonTree&) = delete;
+    BEpsilonTree& operator=(const BEpsilonTree&) = delete;
+    ~BEpsilonTree() { clear(root); }
+
+    void insert(const T& k) override;
+    void remove(const T& k) override;
+    bool search(const T& k) const override;
+    void print() const override;
+
+    // Pushes every buffered message down to the leaves
+    void flush();
+    // Sorted copy of the keys for read-only lookups; buffered messages are
+    // applied to the copy, the tree is left as it is
+    StaticSearchTree<T> freeze() const;
+
+    const Stats& getStats() const { return stats; }
+    // Node memory; slack is unused vector capacity
+    MemoryFootprint memory_footprint() const;
+};
+
+template<typename T, typename Allocator, typename Stats>
+inline BEpsilonTree<T, Allocator, Stats>::BEpsilonTree(int fanout, int bufferCapacity, int leafCapacity, const Allocator& allocator)
+    : root(nullptr), fanout(static_cast<std::size_t>(std::max(fanout, 3))),
+      bufferCapacity(static_cast<std::size_t>(std::max(bufferCapacity, 2 * fanout))),
+      leafCapacity(static_cast<std::size_t>(std::max(leafCapacity, 2))),
+      logCapacity(std::max<std::size_t>(32, this->bufferCapacity / 4)),
+      logKeys(allocator), logOps(allocator), scratchLeaf(allocator), scratchKeys(allocator), scratchOps(allocator),
+      alloc(allocator), nodeAlloc(allocator) {
+    root = createNode(true);
+    logKeys.reserve(logCapacity);
+    logOps.reserve(logCapacity);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline typename BEpsilonTree<T, Allocator, Stats>::Node* BEpsilonTree<T, Allocator, Stats>::createNode(bool leaf) {
+    Node* node = NodeTraits::allocate(nodeAlloc, 1);
+    NodeTraits::construct(nodeAlloc, node, leaf, alloc);
+    stats.allocation();
+    return node;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::destroyNode(Node* node) {
+    NodeTraits::destroy(nodeAlloc, node);
+    NodeTraits::deallocate(nodeAlloc, node, 1);
+    stats.deallocation();
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::clear(Node* node) {
+    if (node == nullptr)
+        return;
+    for (Node* child : node->children)
+        clear(child);
+    destroyNode(node);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::insert(const T& k) {
+    log(k, Insert);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::remove(const T& k) {
+    log(k, Erase);
+}
+
+// Keeps the log sorted as it fills, so a full log is a run as it stands;
+// a message for a key already in it replaces the older one
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::log(const T& k, Op op) {
+    std::size_t pos = static_cast<std::size_t>(KeySearch<T>::lowerBound(logKeys.data(), static_cast<int>(logKeys.size()), k));
+    if (pos < logKeys.size() && !(k < logKeys[pos])) {
+        logOps[pos] = op;
+        return;
+    }
+    logKeys.insert(logKeys.begin() + pos, k);
+    logOps.insert(logOps.begin() + pos, op);
+    if (logKeys.size() == logCapacity)
+        flushLog();
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::flushLog() {
+    if (logKeys.empty())
+        return;
+    Split out(alloc);
+    deliver(root, logKeys.data(), logOps.data(), logKeys.size(), out);
+    logKeys.clear();
+    logOps.clear();
+    grow(out);
+}
+
+// Hands node a sorted run of messages. A leaf applies them; an inner node
+// merges them into its buffer and flushes while that is over capacity.
+// Nodes split off on the way are returned in out.
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::deliver(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, Split& out) {
+    if (node->leaf) {
+        apply(node, keys, ops, n);
+        if (node->keys.size() > leafCapacity)
+            splitLeaf(node, out);
+        return;
+    }
+
+    merge(node, keys, ops, n);
+    while (node->pending.size() > bufferCapacity)
+        flushChild(node);
+    if (node->children.size() > fanout)
+        splitInner(node, out);
+}
+
+// lowerBound of k in keys[0, n), looking within the first gap keys first
+template<typename T, typename Allocator, typename Stats>
+inline std::size_t BEpsilonTree<T, Allocator, Stats>::seek(const T* keys, std::size_t n, const T& k, std::size_t gap) {
+    if (gap < n && !(keys[gap] < k))
+        n = gap;
+    return static_cast<std::size_t>(KeySearch<T>::lowerBound(keys, static_cast<int>(n), k));
+}
+
+// Merges a sorted run into node's buffer, the run winning on equal keys.
+// A run much shorter than the buffer is placed message by message with a
+// search, copying the buffer between them in blocks; otherwise both are
+// walked in step, without branching on the comparison.
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::merge(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n) {
+    if (n == 0)
+        return;
+    const T* old = node->pending.data();
+    const std::uint8_t* oldOps = node->ops.data();
+    std::size_t m = node->pending.size();
+    Keys& merged = scratchKeys;
+    Ops& mergedOps = scratchOps;
+    merged.resize(m + n);
+    mergedOps.resize(m + n);
+    T* out = merged.data();
+    std::uint8_t* outOps = mergedOps.data();
+    std::uint32_t* starts = node->starts.data();
+    std::size_t last = node->children.size();
+    std::size_t i = 0, j = 0;
+    bool sparse = m > sparseRatio * n;
+
+    if (sparse) {
+        // the children's runs move right by the new messages before them
+        std::size_t gap = 2 * m / n + 1;
+        std::size_t c = 0;
+        std::uint32_t added = 0;
+        for (; j < n; j++) {
+            while (c + 1 < last && !(keys[j] < node->keys[c]))
+                starts[++c] += added;
+            std::size_t p = i + seek(old + i, m - i, keys[j], gap);
+            out = std::copy(old + i, old + p, out);
+            outOps = std::copy(oldOps + i, oldOps + p, outOps);
+            *out++ = keys[j];
+            *outOps++ = ops[j];
+            bool replaced = p < m && !(keys[j] < old[p]);
+            added += !replaced;
+            i = replaced ? p + 1 : p;
+        }
+        while (c < last)
+            starts[++c] += added;
+    }
+    else {
+        while (i < m && j < n) {
+            bool fromOld = old[i] < keys[j];
+            bool same = !fromOld && !(keys[j] < old[i]);
+            *out++ = fromOld ? old[i] : keys[j];
+            *outOps++ = fromOld ? oldOps[i] : ops[j];
+            i += fromOld || same;
+            j += !fromOld;
+        }
+        out = std::copy(keys + j, keys + n, out);
+        outOps = std::copy(ops + j, ops + n, outOps);
+    }
+    out = std::copy(old + i, old + m, out);
+    std::copy(oldOps + i, oldOps + m, outOps);
+    merged.resize(static_cast<std::size_t>(out - merged.data()));
+    mergedOps.resize(merged.size());
+
+    if (!sparse) {
+        // the children's runs start at their pivots
+        for (std::size_t c = 1; c < last; c++)
+            starts[c] = static_cast<std::uint32_t>(KeySearch<T>::lowerBound(merged.data(), static_cast<int>(merged.size()), node->keys[c - 1]));
+        starts[last] = static_cast<std::uint32_t>(merged.size());
+    }
+    node->pending.swap(merged);
+    node->ops.swap(mergedOps);
+}
+
+// Applies a sorted run to a leaf, the same way
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::apply(Node* leaf, const T* keys, const std::uint8_t* ops, std::size_t n) {
+    if (n == 0)
+        return;
+    const T* old = leaf->keys.data();
+    std::size_t m = leaf->keys.size();
+    Keys& merged = scratchLeaf;
+    merged.resize(m + n);
+    T* out = merged.data();
+    std::size_t i = 0, j = 0;
+
+    if (m > sparseRatio * n) {
+        std::size_t gap = 2 * m / n + 1;
+        for (; j < n; j++) {
+            std::size_t p = i + seek(old + i, m - i, keys[j], gap);
+            out = std::copy(old + i, old + p, out);
+            if (ops[j] == Insert)
+                *out++ = keys[j];
+            i = p < m && !(keys[j] < old[p]) ? p + 1 : p;
+        }
+    }
+    else {
+        // an erase is written out like an insert, but not kept
+        while (i < m && j < n) {
+            bool fromOld = old[i] < keys[j];
+            bool same = !fromOld && !(keys[j] < old[i]);
+            *out = fromOld ? old[i] : keys[j];
+            out += fromOld || ops[j] == Insert;
+            i += fromOld || same;
+            j += !fromOld;
+        }
+        for (; j < n; j++) {
+            if (ops[j] == Insert)
+                *out++ = keys[j];
+        }
+    }
+    out = std::copy(old + i, old + m, out);
+    merged.resize(static_cast<std::size_t>(out - merged.data()));
+    leaf->keys.swap(merged);
+}
+
+// Moves the largest run bound for a single child down to it
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::flushChild(Node* node) {
+    std::vector<std::uint32_t, IndexAllocator>& starts = node->starts;
+    std::size_t best = 0;
+    for (std::size_t c = 1; c < node->children.size(); c++) {
+        if (starts[c + 1] - starts[c] > starts[best + 1] - starts[best])
+            best = c;
+    }
+    std::size_t from = starts[best], to = starts[best + 1];
+
+    // the child only touches its own vectors, so the run can stay in place
+    Split out(alloc);
+    deliver(node->children[best], node->pending.data() + from, node->ops.data() + from, to - from, out);
+    node->pending.erase(node->pending.begin() + from, node->pending.begin() + to);
+    node->ops.erase(node->ops.begin() + from, node->ops.begin() + to);
+    for (std::size_t c = best + 1; c < starts.size(); c++)
+        starts[c] -= static_cast<std::uint32_t>(to - from);
+
+    // nodes split off the child start out with nothing buffered
+    node->keys.insert(node->keys.begin() + best, out.pivots.begin(), out.pivots.end());
+    node->children.insert(node->children.begin() + best + 1, out.nodes.begin(), out.nodes.end());
+    starts.insert(starts.begin() + best + 1, out.nodes.size(), starts[best]);
+}
+
+// Cuts an overflowing leaf into pieces of at most leafCapacity keys
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::splitLeaf(Node* leaf, Split& out) {
+    std::size_t n = leaf->keys.size();
+    std::size_t pieces = (n + leafCapacity - 1) / leafCapacity;
+    for (std::size_t p = 1; p < pieces; p++) {
+        std::size_t from = n * p / pieces, to = n * (p + 1) / pieces;
+        Node* right = createNode(true);
+        right->keys.assign(leaf->keys.begin() + from, leaf->keys.begin() + to);
+        out.pivots.push_back(leaf->keys[from]);
+        out.nodes.push_back(right);
+        stats.split();
+    }
+    leaf->keys.resize(n / pieces);
+}
+
+// Cuts an inner node into pieces of at most fanout children; each piece
+// takes the buffered messages for its children.
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::splitInner(Node* node, Split& out) {
+    std::size_t n = node->children.size();
+    std::size_t pieces = (n + fanout - 1) / fanout;
+    const std::uint32_t* starts = node->starts.data();
+    for (std::size_t p = 1; p < pieces; p++) {
+        std::size_t from = n * p / pieces, to = n * (p + 1) / pieces;
+        Node* right = createNode(false);
+        right->children.assign(node->children.begin() + from, node->children.begin() + to);
+        right->keys.assign(node->keys.begin() + from, node->keys.begin() + (to - 1));
+        right->pending.assign(node->pending.begin() + starts[from], node->pending.begin() + starts[to]);
+        right->ops.assign(node->ops.begin() + starts[from], node->ops.begin() + starts[to]);
+        for (std::size_t c = from; c <= to; c++)
+            right->starts.push_back(starts[c] - starts[from]);
+
+        out.pivots.push_back(node->keys[from - 1]);
+        out.nodes.push_back(right);
+        stats.split();
+    }
+
+    std::size_t keep = n / pieces;
+    node->pending.resize(starts[keep]);
+    node->ops.resize(starts[keep]);
+    node->starts.resize(keep + 1);
+    node->children.resize(keep);
+    node->keys.resize(keep - 1);
+}
+
+// Puts a new root above the old one and the nodes split off it
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::grow(Split& out) {
+    while (!out.nodes.empty()) {
+        Node* top = createNode(false);
+        top->children.push_back(root);
+        top->children.insert(top->children.end(), out.nodes.begin(), out.nodes.end());
+        top->keys.swap(out.pivots);
+        top->starts.assign(top->children.size() + 1, 0);
+        root = top;
+
+        out.pivots.clear();
+        out.nodes.clear();
+        if (top->children.size() > fanout)
+            splitInner(top, out);
+    }
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BEpsilonTree<T, Allocator, Stats>::search(const T& k) const {
+    int logged = KeySearch<T>::lowerBound(logKeys.data(), static_cast<int>(logKeys.size()), k);
+    if (logged < static_cast<int>(logKeys.size()) && !(k < logKeys[logged]))
+        return logOps[logged] == Insert;
+
+    const Node* node = root;
+    int depth = 1;
+    while (!node->leaf) {
+        // only the messages for the child the key belongs to
+        int c = KeySearch<T>::upperBound(node->keys.data(), static_cast<int>(node->keys.size()), k);
+        const T* run = node->pending.data() + node->starts[c];
+        int n = static_cast<int>(node->starts[c + 1] - node->starts[c]);
+        int pos = KeySearch<T>::lowerBound(run, n, k);
+        if (pos < n && !(k < run[pos])) {
+            stats.depth(depth);
+            return node->ops[node->starts[c] + pos] == Insert;
+        }
+        node = node->children[c];
+        depth++;
+    }
+    stats.depth(depth);
+
+    int n = static_cast<int>(node->keys.size());
+    int pos = KeySearch<T>::lowerBound(node->keys.data(), n, k);
+    return pos < n && !(k < node->keys[pos]);
+}
+
+// Like deliver, but then empties node's buffer into every child in turn,
+// so the whole subtree ends up with its messages applied
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::drain(Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, Split& out) {
+    if (node->leaf) {
+        deliver(node, keys, ops, n, out);
+        return;
+    }
+
+    merge(node, keys, ops, n);
+    // right to left, so nodes split off a child do not move the rest
+    for (std::size_t c = node->children.size(); c-- > 0;) {
+        std::uint32_t from = node->starts[c], to = node->starts[c + 1];
+        Split childOut(alloc);
+        drain(node->children[c], node->pending.data() + from, node->ops.data() + from, to - from, childOut);
+        node->keys.insert(node->keys.begin() + c, childOut.pivots.begin(), childOut.pivots.end());
+        node->children.insert(node->children.begin() + c + 1, childOut.nodes.begin(), childOut.nodes.end());
+    }
+    node->pending.clear();
+    node->ops.clear();
+    node->starts.assign(node->children.size() + 1, 0);
+    if (node->children.size() > fanout)
+        splitInner(node, out);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::flush() {
+    flushLog();
+    Split out(alloc);
+    drain(root, nullptr, nullptr, 0, out);
+    grow(out);
+}
+
+// Appends the keys of node's subtree in order, as they read with the
+// messages from above (keys, ops) and those buffered below applied
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::collect(const Node* node, const T* keys, const std::uint8_t* ops, std::size_t n, std::vector<T>& out) const {
+    if (node->leaf) {
+        std::size_t i = 0;
+        for (std::size_t j = 0; j < n; j++) {
+            while (i < node->keys.size() && node->keys[i] < keys[j])
+                out.push_back(node->keys[i++]);
+            if (i < node->keys.size() && !(keys[j] < node->keys[i]))
+                i++;
+            if (ops[j] == Insert)
+                out.push_back(keys[j]);
+        }
+        out.insert(out.end(), node->keys.begin() + i, node->keys.end());
+        return;
+    }
+
+    // messages from above are newer than the buffer's
+    std::vector<T> merged;
+    std::vector<std::uint8_t> mergedOps;
+    std::size_t i = 0, j = 0;
+    while (i < node->pending.size() || j < n) {
+        if (j == n || (i < node->pending.size() && node->pending[i] < keys[j])) {
+            merged.push_back(node->pending[i]);
+            mergedOps.push_back(node->ops[i++]);
+        }
+        else {
+            if (i < node->pending.size() && !(keys[j] < node->pending[i]))
+                i++;
+            merged.push_back(keys[j]);
+            mergedOps.push_back(ops[j++]);
+        }
+    }
+
+    std::size_t from = 0;
+    for (std::size_t c = 0; c < node->children.size(); c++) {
+        std::size_t to = merged.size();
+        if (c + 1 < node->children.size())
+            to = std::lower_bound(merged.begin(), merged.end(), node->keys[c]) - merged.begin();
+        collect(node->children[c], merged.data() + from, mergedOps.data() + from, to - from, out);
+        from = to;
+    }
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline StaticSearchTree<T> BEpsilonTree<T, Allocator, Stats>::freeze() const {
+    std::vector<T> out;
+    collect(root, logKeys.data(), logOps.data(), logKeys.size(), out);
+    return StaticSearchTree<T>(std::move(out));
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::print() const {
+    if (!logKeys.empty())
+        std::cout << "log: " << logKeys.size() << " messages" << std::endl;
+    printRecursive(root, 0);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::printRecursive(const Node* node, int indent) const {
+    std::cout << std::string(indent, ' ');
+    for (const T& k : node->keys)
+        std::cout << k << " ";
+    if (!node->leaf)
+        std::cout << "(" << node->pending.size() << " buffered)";
+    std::cout << std::endl;
+    for (const Node* child : node->children)
+        printRecursive(child, indent + 4);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BEpsilonTree<T, Allocator, Stats>::footprint(const Node* node, MemoryFootprint& total) const {
+    total.bytes += sizeof(Node) + node->keys.capacity() * sizeof(T) + node->children.capacity() * sizeof(Node*)
+                 + node->pending.capacity() * sizeof(T) + node->ops.capacity() + node->starts.capacity() * sizeof(std::uint32_t);
+    total.slack += (node->keys.capacity() - node->keys.size()) * sizeof(T)
+                 + (node->children.capacity() - node->children.size()) * sizeof(Node*)
+                 + (node->pending.capacity() - node->pending.size()) * sizeof(T)
+                 + (node->ops.capacity() - node->ops.size())
+                 + (node->starts.capacity() - node->starts.size()) * sizeof(std::uint32_t);
+    for (const Node* child : node->children)
+        footprint(child, total);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline MemoryFootprint BEpsilonTree<T, Allocator, Stats>::memory_footprint() const {
+    MemoryFootprint total{ logKeys.capacity() * sizeof(T) + logOps.capacity(), 0 };
+    footprint(root, total);
+    return total;
+}
@@ -0,0 +1,484 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include "ITree.h"
+#include "KeySearch.h"
+
+// Internal nodes hold separators only (every key in children[i] is <= keys[i]
+// <= every key in children[i + 1]); all values live in the leaves, which are
+// linked in key order. Leaves carry no child array.
+template <typename T>
+class BPlusTreeNode {
+public:
+    T* keys;
+    int t;
+    BPlusTreeNode** children;
+    int n;
+    bool leaf;
+    BPlusTreeNode* prev;
+    BPlusTreeNode* next;
+
+    BPlusTreeNode(bool isLeaf, int minDegree) {
+        t = minDegree;
+        leaf = isLeaf;
+        keys = new T[2 * t - 1];
+        children = isLeaf ? nullptr : new BPlusTreeNode * [2 * t];
+        n = 0;
+        prev = nullptr;
+        next = nullptr;
+    }
+
+    ~BPlusTreeNode() {
+        delete[] keys;
+        delete[] children;
+    }
+};
+
+template <typename T>
+class BPlusTree : public ITree<T> {
+private:
+    BPlusTreeNode<T>* root;
+    BPlusTreeNode<T>* head;
+    BPlusTreeNode<T>* tail;
+    int t;
+    std::size_t count;
+
+    void splitChild(BPlusTreeNode<T>* x, int i);
+    void insertNonFull(BPlusTreeNode<T>* node, const T& k);
+    bool remove(BPlusTreeNode<T>* node, const T& k);
+    void rebalance(BPlusTreeNode<T>* x, int i);
+    void merge(BPlusTreeNode<T>* x, int i);
+    BPlusTreeNode<T>* findLeaf(const T& k, int& pos) const;
+    void clear(BPlusTreeNode<T>* node);
+    void printRecursive(BPlusTreeNode<T>* node, int indent) const;
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() : leaf(nullptr), pos(0), tree(nullptr) {}
+
+        reference operator*() const { return leaf->keys[pos]; }
+        pointer operator->() const { return &leaf->keys[pos]; }
+
+        const_iterator& operator++() {
+            if (++pos == leaf->n) {
+                leaf = leaf->next;
+                pos = 0;
+            }
+            return *this;
+        }
+
+        const_iterator& operator--() {
+            if (leaf == nullptr) {
+                leaf = tree->tail;
+                pos = leaf->n - 1;
+            }
+            else if (pos == 0) {
+                leaf = leaf->prev;
+                pos = leaf->n - 1;
+            }
+            else {
+                pos--;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        const_iterator operator--(int) { const_iterator old = *this; --*this; return old; }
+
+        bool operator==(const const_iterator& other) const { return leaf == other.leaf && pos == other.pos; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class BPlusTree;
+        const_iterator(const BPlusTreeNode<T>* l, int p, const BPlusTree* owner) : leaf(l), pos(p), tree(owner) {}
+
+        const BPlusTreeNode<T>* leaf;
+        int pos;
+        const BPlusTree* tree;
+    };
+
+    using iterator = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    BPlusTree(int minDegree) {
+        root = nullptr;
+        head = nullptr;
+        tail = nullptr;
+        t = minDegree;
+        count = 0;
+    }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    ~BPlusTree() {
+        clear(root);
+    }
+    void traverse() const;
+    bool search(const T& k) const override;
+    void insert(const T& k) override;
+    void remove(const T& k) override;
+    void print() const override;
+    std::size_t size() const { return count; }
+
+    const_iterator begin() const { return const_iterator(head, 0, this); }
+    const_iterator end() const { return const_iterator(nullptr, 0, this); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+    const_iterator lower_bound(const T& k) const;
+    const_iterator upper_bound(const T& k) const;
+
+    // Calls f for every key in [lo, hi] in order, walking the leaf chain.
+    // If f returns bool, returning false stops the scan. Returns the number
+    // of keys visited.
+    template<typename F>
+    std::size_t scan(const T& lo, const T& hi, F&& f) const;
+};
+
+template<typename T>
+inline void BPlusTree<T>::splitChild(BPlusTreeNode<T>* x, int i) {
+    BPlusTreeNode<T>* y = x->children[i];
+    BPlusTreeNode<T>* z = new BPlusTreeNode<T>(y->leaf, t);
+    T separator;
+
+    if (y->leaf) {
+        // leaf split copies the first key of the right half up
+        z->n = t;
+        for (int j = 0; j < t; j++)
+            z->keys[j] = y->keys[j + t - 1];
+        y->n = t - 1;
+        separator = z->keys[0];
+
+        z->prev = y;
+        z->next = y->next;
+        if (y->next)
+            y->next->prev = z;
+        else
+            tail = z;
+        y->next = z;
+    }
+    else {
+        z->n = t - 1;
+        for (int j = 0; j < t - 1; j++)
+            z->keys[j] = y->keys[j + t];
+        for (int j = 0; j < t; j++)
+            z->children[j] = y->children[j + t];
+        y->n = t - 1;
+        separator = y->keys[t - 1];
+    }
+
+    for (int j = x->n; j >= i + 1; j--)
+        x->children[j + 1] = x->children[j];
+    x->children[i + 1] = z;
+
+    for (int j = x->n - 1; j >= i; j--)
+        x->keys[j + 1] = x->keys[j];
+    x->keys[i] = separator;
+    x->n++;
+}
+
+template<typename T>
+inline void BPlusTree<T>::insertNonFull(BPlusTreeNode<T>* node, const T& k) {
+    while (!node->leaf) {
+        int i = KeySearch<T>::upperBound(node->keys, node->n, k);
+        if (node->children[i]->n == 2 * t - 1) {
+            splitChild(node, i);
+            if (!(k < node->keys[i]))
+                i++;
+        }
+        node = node->children[i];
+    }
+
+    int i = KeySearch<T>::upperBound(node->keys, node->n, k);
+    for (int j = node->n; j > i; j--)
+        node->keys[j] = node->keys[j - 1];
+    node->keys[i] = k;
+    node->n++;
+}
+
+template<typename T>
+inline void BPlusTree<T>::insert(const T& k) {
+    if (root == nullptr) {
+        root = new BPlusTreeNode<T>(true, t);
+        root->keys[0] = k;
+        root->n = 1;
+        head = tail = root;
+    }
+    else {
+        if (root->n == 2 * t - 1) {
+            BPlusTreeNode<T>* s = new BPlusTreeNode<T>(false, t);
+            s->children[0] = root;
+            splitChild(s, 0);
+            root = s;
+        }
+        insertNonFull(root, k);
+    }
+    count++;
+}
+
+// Descends to the leftmost leaf that can hold k. pos is the first slot in
+// that leaf that is not less than k and may equal n, in which case the
+// answer starts at the next leaf.
+template<typename T>
+inline BPlusTreeNode<T>* BPlusTree<T>::findLeaf(const T& k, int& pos) const {
+    BPlusTreeNode<T>* node = root;
+    while (!node->leaf)
+        node = node->children[KeySearch<T>::lowerBound(node->keys, node->n, k)];
+    pos = KeySearch<T>::lowerBound(node->keys, node->n, k);
+    return node;
+}
+
+template<typename T>
+inline typename BPlusTree<T>::const_iterator BPlusTree<T>::lower_bound(const T& k) const {
+    if (root == nullptr)
+        return end();
+
+    int pos;
+    BPlusTreeNode<T>* leaf = findLeaf(k, pos);
+    if (pos == leaf->n)
+        return const_iterator(leaf->next, 0, this);
+    return const_iterator(leaf, pos, this);
+}
+
+template<typename T>
+inline typename BPlusTree<T>::const_iterator BPlusTree<T>::upper_bound(const T& k) const {
+    if (root == nullptr)
+        return end();
+
+    BPlusTreeNode<T>* node = root;
+    while (!node->leaf)
+        node = node->children[KeySearch<T>::upperBound(node->keys, node->n, k)];
+    int pos = KeySearch<T>::upperBound(node->keys, node->n, k);
+    if (pos == node->n)
+        return const_iterator(node->next, 0, this);
+    return const_iterator(node, pos, this);
+}
+
+template<typename T>
+inline bool BPlusTree<T>::search(const T& k) const {
+    const_iterator it = lower_bound(k);
+    return it != end() && !(k < *it);
+}
+
+template<typename T>
+template<typename F>
+inline std::size_t BPlusTree<T>::scan(const T& lo, const T& hi, F&& f) const {
+    if (root == nullptr || hi < lo)
+        return 0;
+
+    int pos;
+    const BPlusTreeNode<T>* leaf = findLeaf(lo, pos);
+    std::size_t visited = 0;
+
+    for (; leaf != nullptr; leaf = leaf->next, pos = 0) {
+#if defined(__GNUC__) || defined(__clang__)
+        if (leaf->next)
+            __builtin_prefetch(leaf->next->keys);
+#endif
+        const T* keys = leaf->keys;
+        int n = leaf->n;
+        for (; pos < n; pos++) {
+            if (hi < keys[pos])
+                return visited;
+            visited++;
+            if constexpr (std::is_same_v<std::invoke_result_t<F&, const T&>, bool>) {
+                if (!f(keys[pos]))
+                    return visited;
+            }
+            else {
+                f(keys[pos]);
+            }
+        }
+    }
+    return visited;
+}
+
+template<typename T>
+inline void BPlusTree<T>::remove(const T& k) {
+    if (root == nullptr || !remove(root, k))
+        return;
+
+    count--;
+    if (root->n == 0) {
+        BPlusTreeNode<T>* old = root;
+        if (root->leaf) {
+            root = nullptr;
+            head = tail = nullptr;
+        }
+        else {
+            root = root->children[0];
+        }
+        delete old;
+    }
+}
+
+// Removes one occurrence of k below node and repairs underfull children on
+// the way back up. Returns false if k was not found.
+template<typename T>
+inline bool BPlusTree<T>::remove(BPlusTreeNode<T>* node, const T& k) {
+    if (node->leaf) {
+        int pos = KeySearch<T>::lowerBound(node->keys, node->n, k);
+        if (pos == node->n || k < node->keys[pos])
+            return false;
+        for (int j = pos + 1; j < node->n; j++)
+            node->keys[j - 1] = node->keys[j];
+        node->n--;
+        return true;
+    }
+
+    int i = KeySearch<T>::lowerBound(node->keys, node->n, k);
+    while (true) {
+        if (remove(node->children[i], k)) {
+            if (node->children[i]->n < t - 1)
+                rebalance(node, i);
+            return true;
+        }
+        // equal separators: the key may start in the next child
+        if (i < node->n && !(k < node->keys[i]))
+            i++;
+        else
+            return false;
+    }
+}
+
+template<typename T>
+inline void BPlusTree<T>::rebalance(BPlusTreeNode<T>* x, int i) {
+    BPlusTreeNode<T>* c = x->children[i];
+    BPlusTreeNode<T>* left = i > 0 ? x->children[i - 1] : nullptr;
+    BPlusTreeNode<T>* right = i < x->n ? x->children[i + 1] : nullptr;
+
+    if (left && left->n > t - 1) {
+        for (int j = c->n - 1; j >= 0; j--)
+            c->keys[j + 1] = c->keys[j];
+        if (c->leaf) {
+            c->keys[0] = left->keys[left->n - 1];
+            x->keys[i - 1] = c->keys[0];
+        }
+        else {
+            for (int j = c->n; j >= 0; j--)
+                c->children[j + 1] = c->children[j];
+            c->keys[0] = x->keys[i - 1];
+            c->children[0] = left->children[left->n];
+            x->keys[i - 1] = left->keys[left->n - 1];
+        }
+        c->n++;
+        left->n--;
+    }
+    else if (right && right->n > t - 1) {
+        if (c->leaf) {
+            c->keys[c->n] = right->keys[0];
+            for (int j = 1; j < right->n; j++)
+                right->keys[j - 1] = right->keys[j];
+            x->keys[i] = right->keys[0];
+        }
+        else {
+            c->keys[c->n] = x->keys[i];
+            c->children[c->n + 1] = right->children[0];
+            x->keys[i] = right->keys[0];
+            for (int j = 1; j < right->n; j++)
+                right->keys[j - 1] = right->keys[j];
+            for (int j = 1; j <= right->n; j++)
+                right->children[j - 1] = right->children[j];
+        }
+        c->n++;
+        right->n--;
+    }
+    else if (left) {
+        merge(x, i - 1);
+    }
+    else {
+        merge(x, i);
+    }
+}
+
+// Appends children[i + 1] to children[i]. Leaves drop the separator,
+// internal nodes pull it down.
+template<typename T>
+inline void BPlusTree<T>::merge(BPlusTreeNode<T>* x, int i) {
+    BPlusTreeNode<T>* left = x->children[i];
+    BPlusTreeNode<T>* right = x->children[i + 1];
+
+    if (left->leaf) {
+        for (int j = 0; j < right->n; j++)
+            left->keys[left->n + j] = right->keys[j];
+        left->n += right->n;
+
+        left->next = right->next;
+        if (right->next)
+            right->next->prev = left;
+        else
+            tail = left;
+    }
+    else {
+        left->keys[left->n] = x->keys[i];
+        for (int j = 0; j < right->n; j++)
+            left->keys[left->n + 1 + j] = right->keys[j];
+        for (int j = 0; j <= right->n; j++)
+            left->children[left->n + 1 + j] = right->children[j];
+        left->n += right->n + 1;
+    }
+
+    for (int j = i + 1; j < x->n; j++)
+        x->keys[j - 1] = x->keys[j];
+    for (int j = i + 2; j <= x->n; j++)
+        x->children[j - 1] = x->children[j];
+    x->n--;
+
+    delete right;
+}
+
+template<typename T>
+inline void BPlusTree<T>::clear(BPlusTreeNode<T>* node) {
+    if (!node) return;
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; i++)
+            clear(node->children[i]);
+    }
+    delete node;
+}
+
+template<typename T>
+inline void BPlusTree<T>::traverse() const {
+    if (head == nullptr) {
+        std::cout << "Tree is empty\n";
+        return;
+    }
+    for (const BPlusTreeNode<T>* leaf = head; leaf; leaf = leaf->next) {
+        for (int i = 0; i < leaf->n; i++)
+            std::cout << " " << leaf->keys[i];
+    }
+}
+
+template<typename T>
+inline void BPlusTree<T>::print() const {
+    printRecursive(root, 0);
+}
+
+template<typename T>
+inline void BPlusTree<T>::printRecursive(BPlusTreeNode<T>* node, int indent) const {
+    if (!node) return;
+
+    for (int i = 0; i < indent; ++i)
+        std::cout << "  ";
+
+    std::cout << (node->leaf ? "(" : "[");
+    for (int i = 0; i < node->n; ++i) {
+        std::cout << node->keys[i];
+        if (i != node->n - 1) std::cout << " ";
+    }
+    std::cout << (node->leaf ? ")\n" : "]\n");
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; ++i)
+            printRecursive(node->children[i], indent + 1);
+    }
+}
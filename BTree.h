@@ -1,5 +1,18 @@
 #pragma once
+#include <bit>
+#include <fstream>
 #include <iostream>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Allocator.h"
+#include "ITree.h"
+#include "KeySearch.h"
+#include "Snapshot.h"
+#include "StaticSearchTree.h"
+#include "TreeStats.h"
 using namespace std;
 
 template <typename T>
@@ -11,50 +24,130 @@ public:
     int n;
     bool leaf;
 
-    BTreeNode(bool isLeaf, int minDegree) {
+    // The key and child arrays belong to the tree that allocated the node;
+    // leaves have no child array.
+    BTreeNode(bool isLeaf, int minDegree, T* keyStorage, BTreeNode** childStorage) {
         t = minDegree;
         leaf = isLeaf;
-        keys = new T[2 * t - 1];
-        children = new BTreeNode * [2 * t];
+        keys = keyStorage;
+        children = childStorage;
         n = 0;
     }
-
-    ~BTreeNode() {
-        delete[] keys;
-        delete[] children;
-    }
 };
 
-template <typename T>
-class BTree {
+template <typename T, typename Allocator = std::allocator<T>, typename Stats = NullStats>
+class BTree : public ITree<T> {
 private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<BTreeNode<T>>;
+    using KeyAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using ChildAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<BTreeNode<T>*>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+    using KeyTraits = std::allocator_traits<KeyAllocator>;
+    using ChildTraits = std::allocator_traits<ChildAllocator>;
+
     BTreeNode<T>* root;
     int t;
+    NodeAllocator nodeAlloc;
+    KeyAllocator keyAlloc;
+    ChildAllocator childAlloc;
+    [[no_unique_address]] mutable Stats stats;
 
+    BTreeNode<T>* createNode(bool leaf);
+    void destroyNode(BTreeNode<T>* node);
     void traverse(BTreeNode<T>* node);
-    BTreeNode<T>* search(BTreeNode<T>* node, T k);
+    BTreeNode<T>* search(BTreeNode<T>* node, const T& k) const;
     void splitChild(BTreeNode<T>* x, int i);
     void insertNonFull(BTreeNode<T>* node, T k);
     void clear(BTreeNode<T>* node);
-    void printRecursive(BTreeNode<T>* node, int indent);
+    void printRecursive(BTreeNode<T>* node, int indent) const;
+    void footprint(BTreeNode<T>* node, MemoryFootprint& total) const;
+    std::uint64_t keyCount(BTreeNode<T>* node) const;
+    template<typename F>
+    void visit(BTreeNode<T>* node, F& f) const;
+    bool restore(SnapshotReader& in);
+
+    BTreeNode<T>* removeKey(BTreeNode<T>* node, const T& k);
+    void remove(BTreeNode<T>* node, const T& k);
+    void fill(BTreeNode<T>* x, int i);
+    void moveLeft(BTreeNode<T>* x, int i, int m);
+    void moveRight(BTreeNode<T>* x, int i, int m);
+    void merge(BTreeNode<T>* x, int i);
+    int height(BTreeNode<T>* node) const;
+    bool verify(BTreeNode<T>* node, const T* lo, const T* hi, int depth, int& leafDepth) const;
+    BTreeNode<T>* normalize(BTreeNode<T>* node);
+    BTreeNode<T>* join(BTreeNode<T>* a, T k, BTreeNode<T>* b);
+    std::pair<BTreeNode<T>*, BTreeNode<T>*> split(BTreeNode<T>* x, const T& k, bool inclusive);
+
+    struct BulkLoadState {
+        std::vector<BTreeNode<T>*> spine;
+        int leafTarget;
+        int innerTarget;
+    };
+    BulkLoadState bulkStart(double fillFactor);
+    void bulkPush(BulkLoadState& state, const T& k);
+    void bulkAddSeparator(BulkLoadState& state, std::size_t level, const T& sep, BTreeNode<T>* closed, BTreeNode<T>* next);
+    void bulkFinish(BulkLoadState& state);
 
 public:
     BTree(int minDegree) {
         root = nullptr;
         t = minDegree;
     }
+    BTree(int minDegree, const Allocator& allocator)
+        : nodeAlloc(allocator), keyAlloc(allocator), childAlloc(allocator) {
+        root = nullptr;
+        t = minDegree;
+    }
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
 
     ~BTree() {
         clear(root);
     }
     void traverse();
-    BTreeNode<T>* search(T k);
-    void insert(T k);
-    void print();
+    BTreeNode<T>* find(const T& k) const;
+    bool search(const T& k) const override;
+    void insert(const T& k) override;
+    void remove(const T& k) override;
+    void erase_range(const T& lo, const T& hi);
+    void print() const override;
+
+    // Replaces the contents with the sorted range [first, last) in a single
+    // pass. Nodes are packed to fillFactor of their capacity (never below
+    // the B-tree minimum). Input iterators are fine.
+    template<typename InputIt>
+    void bulk_load(InputIt first, InputIt last, double fillFactor = 1.0);
+
+    // Same, but pulls sorted keys from source(T* buffer, size_t capacity),
+    // which returns how many keys it wrote and 0 at the end of input.
+    template<typename Source>
+    void bulk_load(Source&& source, double fillFactor = 1.0, std::size_t bufferSize = 4096);
+
+    // Snapshots (see Snapshot.h). load bulk-loads the keys into packed
+    // nodes in O(n) without comparisons, and on failure returns false with
+    // the tree unchanged. load(path) maps the file.
+    bool save(std::ostream& out) const;
+    bool save(const std::string& path) const;
+    bool load(std::istream& in);
+    bool load(const std::string& path);
+
+    // Immutable copy for lookups once the tree stops changing
+    StaticSearchTree<T> freeze() const;
+
+    // Key moves through a parent (moveLeft/moveRight) count as rotations.
+    // A node search is counted as log2(n) comparisons.
+    const Stats& getStats() const { return stats; }
+    // Bytes held by nodes and their key/child arrays; slack is the unused
+    // key and child slots plus node padding.
+    MemoryFootprint memory_footprint() const;
+    // Checks the B-tree invariants: keys in order and within their
+    // separators, between t - 1 (except at the root) and 2t - 1 keys per
+    // node, and every leaf at the same depth. For tests and debugging.
+    bool verify() const;
 };
 
-template<typename T>
-inline void BTree<T>::traverse(BTreeNode<T>* node) {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::traverse(BTreeNode<T>* node) {
     int i;
     for (i = 0; i < node->n; i++) {
         if (!node->leaf)
@@ -65,26 +158,64 @@ inline void BTree<T>::traverse(BTreeNode<T>* node) {
         traverse(node->children[i]);
 }
 
-template<typename T>
-inline BTreeNode<T>* BTree<T>::search(BTreeNode<T>* node, T k) {
-    int i = 0;
-    while (i < node->n && k > node->keys[i])
-        i++;
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::createNode(bool leaf) {
+    T* keys = KeyTraits::allocate(keyAlloc, 2 * t - 1);
+    if constexpr (!std::is_trivially_default_constructible_v<T>) {
+        for (int i = 0; i < 2 * t - 1; i++)
+            KeyTraits::construct(keyAlloc, keys + i);
+    }
+    BTreeNode<T>** children = leaf ? nullptr : ChildTraits::allocate(childAlloc, 2 * t);
 
-    if (i < node->n && node->keys[i] == k)
-        return node;
+    BTreeNode<T>* node = NodeTraits::allocate(nodeAlloc, 1);
+    NodeTraits::construct(nodeAlloc, node, leaf, t, keys, children);
+    stats.allocation();
+    return node;
+}
 
-    if (node->leaf)
-        return nullptr;
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::destroyNode(BTreeNode<T>* node) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        for (int i = 0; i < 2 * t - 1; i++)
+            KeyTraits::destroy(keyAlloc, node->keys + i);
+    }
+    KeyTraits::deallocate(keyAlloc, node->keys, 2 * t - 1);
+    if (node->children)
+        ChildTraits::deallocate(childAlloc, node->children, 2 * t);
+
+    NodeTraits::destroy(nodeAlloc, node);
+    NodeTraits::deallocate(nodeAlloc, node, 1);
+    stats.deallocation();
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::search(BTreeNode<T>* node, const T& k) const {
+    int depth = 0;
+    while (true) {
+        depth++;
+        stats.comparison(std::bit_width(static_cast<unsigned>(node->n)));
+        int i = KeySearch<T>::lowerBound(node->keys, node->n, k);
+
+        if (i < node->n && node->keys[i] == k)
+            break;
 
-    return search(node->children[i], k);
+        if (node->leaf) {
+            node = nullptr;
+            break;
+        }
+
+        node = node->children[i];
+    }
+    stats.depth(depth);
+    return node;
 }
 
-template<typename T>
-inline void BTree<T>::splitChild(BTreeNode<T>* x, int i) {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::splitChild(BTreeNode<T>* x, int i) {
     BTreeNode<T>* y = x->children[i];
-    BTreeNode<T>* z = new BTreeNode<T>(y->leaf, t);
+    BTreeNode<T>* z = createNode(y->leaf);
     z->n = t - 1;
+    stats.split();
 
     for (int j = 0; j < t - 1; j++)
         z->keys[j] = y->keys[j + t];
@@ -108,24 +239,19 @@ inline void BTree<T>::splitChild(BTreeNode<T>* x, int i) {
     x->n++;
 }
 
-template<typename T>
-inline void BTree<T>::insertNonFull(BTreeNode<T>* node, T k) {
-    int i = node->n - 1;
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::insertNonFull(BTreeNode<T>* node, T k) {
+    stats.comparison(std::bit_width(static_cast<unsigned>(node->n)));
+    int i = KeySearch<T>::upperBound(node->keys, node->n, k);
 
     if (node->leaf) {
-        while (i >= 0 && k < node->keys[i]) {
-            node->keys[i + 1] = node->keys[i];
-            i--;
-        }
+        for (int j = node->n; j > i; j--)
+            node->keys[j] = node->keys[j - 1];
 
-        node->keys[i + 1] = k;
+        node->keys[i] = k;
         node->n++;
     }
     else {
-        while (i >= 0 && k < node->keys[i])
-            i--;
-
-        i++;
         if (node->children[i]->n == 2 * t - 1) {
             splitChild(node, i);
             if (k > node->keys[i])
@@ -135,40 +261,48 @@ inline void BTree<T>::insertNonFull(BTreeNode<T>* node, T k) {
     }
 }
 
-template<typename T>
-inline void BTree<T>::clear(BTreeNode<T>* node) {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::clear(BTreeNode<T>* node) {
+    if constexpr (isArenaAllocator<Allocator> && std::is_trivially_destructible_v<T>)
+        return;
+
     if (!node) return;
 
     if (!node->leaf) {
         for (int i = 0; i <= node->n; i++)
             clear(node->children[i]);
     }
-    delete node;
+    destroyNode(node);
 }
 
-template<typename T>
-inline void BTree<T>::traverse() {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::traverse() {
     if (root != nullptr)
         traverse(root);
     else
         cout << "Tree is empty\n";
 }
 
-template<typename T>
-inline BTreeNode<T>* BTree<T>::search(T k){
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::find(const T& k) const {
     return (root == nullptr) ? nullptr : search(root, k);
 }
 
-template<typename T>
-inline void BTree<T>::insert(T k) {
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::search(const T& k) const {
+    return find(k) != nullptr;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::insert(const T& k) {
     if (root == nullptr) {
-        root = new BTreeNode<T>(true, t);
+        root = createNode(true);
         root->keys[0] = k;
         root->n = 1;
     }
     else {
         if (root->n == 2 * t - 1) {
-            BTreeNode<T>* s = new BTreeNode<T>(false, t);
+            BTreeNode<T>* s = createNode(false);
             s->children[0] = root;
             splitChild(s, 0);
             int i = (s->keys[0] < k) ? 1 : 0;
@@ -181,13 +315,13 @@ inline void BTree<T>::insert(T k) {
     }
 }
 
-template<typename T>
-inline void BTree<T>::print() {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::print() const {
     printRecursive(root, 0);
 }
 
-template<typename T>
-inline void BTree<T>::printRecursive(BTreeNode<T>* node, int indent) {
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::printRecursive(BTreeNode<T>* node, int indent) const {
     if (!node) return;
 
     for (int i = 0; i < indent; ++i)
@@ -204,4 +338,605 @@ inline void BTree<T>::printRecursive(BTreeNode<T>* node, int indent) {
         for (int i = 0; i <= node->n; ++i)
             printRecursive(node->children[i], indent + 1);
     }
-}
\ No newline at end of file
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline MemoryFootprint BTree<T, Allocator, Stats>::memory_footprint() const {
+    MemoryFootprint total{ 0, 0 };
+    if (root != nullptr)
+        footprint(root, total);
+    return total;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::verify() const {
+    int leafDepth = -1;
+    return root == nullptr || (root->n > 0 && verify(root, nullptr, nullptr, 0, leafDepth));
+}
+
+// Keys equal to a separator may sit on either side of it
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::verify(BTreeNode<T>* node, const T* lo, const T* hi, int depth, int& leafDepth) const {
+    if (node->n > 2 * t - 1 || (node != root && node->n < t - 1))
+        return false;
+    for (int i = 0; i < node->n; i++) {
+        if ((i > 0 && node->keys[i] < node->keys[i - 1]) || (lo && node->keys[i] < *lo) || (hi && *hi < node->keys[i]))
+            return false;
+    }
+
+    if (node->leaf) {
+        if (leafDepth < 0)
+            leafDepth = depth;
+        return depth == leafDepth;
+    }
+    for (int i = 0; i <= node->n; i++) {
+        const T* childLo = i > 0 ? &node->keys[i - 1] : lo;
+        const T* childHi = i < node->n ? &node->keys[i] : hi;
+        if (!node->children[i] || !verify(node->children[i], childLo, childHi, depth + 1, leafDepth))
+            return false;
+    }
+    return true;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::footprint(BTreeNode<T>* node, MemoryFootprint& total) const {
+    constexpr std::size_t padding = sizeof(BTreeNode<T>) - 2 * sizeof(void*) - 2 * sizeof(int) - sizeof(bool);
+    total.bytes += sizeof(BTreeNode<T>) + (2 * t - 1) * sizeof(T);
+    total.slack += padding + (2 * t - 1 - node->n) * sizeof(T);
+    if (node->leaf)
+        return;
+
+    total.bytes += 2 * t * sizeof(BTreeNode<T>*);
+    total.slack += (2 * t - 1 - node->n) * sizeof(BTreeNode<T>*);
+    for (int i = 0; i <= node->n; i++)
+        footprint(node->children[i], total);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::remove(const T& k) {
+    root = removeKey(root, k);
+}
+
+// Removes k from the subtree and collapses an emptied root.
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::removeKey(BTreeNode<T>* node, const T& k) {
+    if (node == nullptr) return nullptr;
+
+    remove(node, k);
+
+    if (node->n == 0) {
+        BTreeNode<T>* child = node->leaf ? nullptr : node->children[0];
+        destroyNode(node);
+        return child;
+    }
+    return node;
+}
+
+// Single top-down pass: every child we descend into has at least t keys,
+// so deleting one key from it never needs to walk back up.
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::remove(BTreeNode<T>* node, const T& k) {
+    while (true) {
+        stats.comparison(std::bit_width(static_cast<unsigned>(node->n)));
+        int i = KeySearch<T>::lowerBound(node->keys, node->n, k);
+
+        if (i < node->n && node->keys[i] == k) {
+            if (node->leaf) {
+                for (int j = i + 1; j < node->n; j++)
+                    node->keys[j - 1] = node->keys[j];
+                node->n--;
+                return;
+            }
+
+            BTreeNode<T>* left = node->children[i];
+            BTreeNode<T>* right = node->children[i + 1];
+            if (left->n >= t) {
+                BTreeNode<T>* cur = left;
+                while (!cur->leaf)
+                    cur = cur->children[cur->n];
+                T pred = cur->keys[cur->n - 1];
+                node->keys[i] = pred;
+                remove(left, pred);
+            }
+            else if (right->n >= t) {
+                BTreeNode<T>* cur = right;
+                while (!cur->leaf)
+                    cur = cur->children[0];
+                T succ = cur->keys[0];
+                node->keys[i] = succ;
+                remove(right, succ);
+            }
+            else {
+                merge(node, i);
+                remove(left, k);
+            }
+            return;
+        }
+
+        if (node->leaf)
+            return;
+
+        bool last = (i == node->n);
+        if (node->children[i]->n < t)
+            fill(node, i);
+
+        if (last && i > node->n)
+            node = node->children[i - 1];
+        else
+            node = node->children[i];
+    }
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::fill(BTreeNode<T>* x, int i) {
+    if (i != 0 && x->children[i - 1]->n >= t)
+        moveRight(x, i - 1, 1);
+    else if (i != x->n && x->children[i + 1]->n >= t)
+        moveLeft(x, i, 1);
+    else if (i != x->n)
+        merge(x, i);
+    else
+        merge(x, i - 1);
+}
+
+// Moves m keys from children[i + 1] into children[i] through keys[i].
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::moveLeft(BTreeNode<T>* x, int i, int m) {
+    BTreeNode<T>* left = x->children[i];
+    BTreeNode<T>* right = x->children[i + 1];
+    stats.rotation();
+
+    left->keys[left->n] = x->keys[i];
+    for (int j = 0; j < m - 1; j++)
+        left->keys[left->n + 1 + j] = right->keys[j];
+    x->keys[i] = right->keys[m - 1];
+
+    for (int j = m; j < right->n; j++)
+        right->keys[j - m] = right->keys[j];
+
+    if (!left->leaf) {
+        for (int j = 0; j < m; j++)
+            left->children[left->n + 1 + j] = right->children[j];
+        for (int j = m; j <= right->n; j++)
+            right->children[j - m] = right->children[j];
+    }
+
+    left->n += m;
+    right->n -= m;
+}
+
+// Moves m keys from children[i] into children[i + 1] through keys[i].
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::moveRight(BTreeNode<T>* x, int i, int m) {
+    BTreeNode<T>* left = x->children[i];
+    BTreeNode<T>* right = x->children[i + 1];
+    stats.rotation();
+
+    for (int j = right->n - 1; j >= 0; j--)
+        right->keys[j + m] = right->keys[j];
+    right->keys[m - 1] = x->keys[i];
+    for (int j = 0; j < m - 1; j++)
+        right->keys[j] = left->keys[left->n - m + 1 + j];
+    x->keys[i] = left->keys[left->n - m];
+
+    if (!right->leaf) {
+        for (int j = right->n; j >= 0; j--)
+            right->children[j + m] = right->children[j];
+        for (int j = 0; j < m; j++)
+            right->children[j] = left->children[left->n - m + 1 + j];
+    }
+
+    left->n -= m;
+    right->n += m;
+}
+
+// Pulls keys[i] down and appends children[i + 1] to children[i].
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::merge(BTreeNode<T>* x, int i) {
+    BTreeNode<T>* left = x->children[i];
+    BTreeNode<T>* right = x->children[i + 1];
+
+    left->keys[left->n] = x->keys[i];
+    for (int j = 0; j < right->n; j++)
+        left->keys[left->n + 1 + j] = right->keys[j];
+
+    if (!left->leaf) {
+        for (int j = 0; j <= right->n; j++)
+            left->children[left->n + 1 + j] = right->children[j];
+    }
+
+    for (int j = i + 1; j < x->n; j++)
+        x->keys[j - 1] = x->keys[j];
+    for (int j = i + 2; j <= x->n; j++)
+        x->children[j - 1] = x->children[j];
+
+    left->n += right->n + 1;
+    x->n--;
+    destroyNode(right);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline int BTree<T, Allocator, Stats>::height(BTreeNode<T>* node) const {
+    int h = 0;
+    while (node) {
+        h++;
+        node = node->leaf ? nullptr : node->children[0];
+    }
+    return h;
+}
+
+// A split or join piece may end up with an empty root; drop it.
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::normalize(BTreeNode<T>* node) {
+    while (node && node->n == 0) {
+        BTreeNode<T>* child = node->leaf ? nullptr : node->children[0];
+        destroyNode(node);
+        node = child;
+    }
+    return node;
+}
+
+// Joins a < k < b. Both inputs are valid trees whose roots may hold fewer
+// than t - 1 keys; k and the shorter tree are hung off the spine of the
+// taller one at the matching height, splitting full nodes on the way down.
+template<typename T, typename Allocator, typename Stats>
+inline BTreeNode<T>* BTree<T, Allocator, Stats>::join(BTreeNode<T>* a, T k, BTreeNode<T>* b) {
+    int ha = height(a);
+    int hb = height(b);
+
+    if (ha == 0 && hb == 0) {
+        BTreeNode<T>* leaf = createNode(true);
+        leaf->keys[0] = k;
+        leaf->n = 1;
+        return leaf;
+    }
+
+    if (ha == hb) {
+        BTreeNode<T>* s = createNode(false);
+        s->keys[0] = k;
+        s->children[0] = a;
+        s->children[1] = b;
+        s->n = 1;
+        if (a->n + b->n + 1 <= 2 * t - 1)
+            merge(s, 0);
+        else if (a->n < t - 1)
+            moveLeft(s, 0, t - 1 - a->n);
+        else if (b->n < t - 1)
+            moveRight(s, 0, t - 1 - b->n);
+        return normalize(s);
+    }
+
+    if (ha > hb) {
+        BTreeNode<T>* top = a;
+        if (a->n == 2 * t - 1) {
+            top = createNode(false);
+            top->children[0] = a;
+            splitChild(top, 0);
+            ha++;
+        }
+
+        BTreeNode<T>* p = top;
+        for (int h = ha; h > hb + 1; h--) {
+            if (p->children[p->n]->n == 2 * t - 1)
+                splitChild(p, p->n);
+            p = p->children[p->n];
+        }
+
+        p->keys[p->n] = k;
+        if (!p->leaf)
+            p->children[p->n + 1] = b;
+        p->n++;
+
+        if (b && b->n < t - 1) {
+            BTreeNode<T>* sibling = p->children[p->n - 1];
+            if (sibling->n + b->n + 1 <= 2 * t - 1)
+                merge(p, p->n - 1);
+            else
+                moveRight(p, p->n - 1, t - 1 - b->n);
+        }
+        return top;
+    }
+
+    BTreeNode<T>* top = b;
+    if (b->n == 2 * t - 1) {
+        top = createNode(false);
+        top->children[0] = b;
+        splitChild(top, 0);
+        hb++;
+    }
+
+    BTreeNode<T>* p = top;
+    for (int h = hb; h > ha + 1; h--) {
+        if (p->children[0]->n == 2 * t - 1)
+            splitChild(p, 0);
+        p = p->children[0];
+    }
+
+    for (int j = p->n - 1; j >= 0; j--)
+        p->keys[j + 1] = p->keys[j];
+    p->keys[0] = k;
+    if (!p->leaf) {
+        for (int j = p->n; j >= 0; j--)
+            p->children[j + 1] = p->children[j];
+        p->children[0] = a;
+    }
+    p->n++;
+
+    if (a && a->n < t - 1) {
+        BTreeNode<T>* sibling = p->children[1];
+        if (sibling->n + a->n + 1 <= 2 * t - 1)
+            merge(p, 0);
+        else
+            moveLeft(p, 0, t - 1 - a->n);
+    }
+    return top;
+}
+
+// Splits the subtree into keys < k and keys >= k (or <= k and > k when
+// inclusive). Only the nodes on the search path are touched; the subtrees
+// hanging off it are reattached whole by join.
+template<typename T, typename Allocator, typename Stats>
+inline std::pair<BTreeNode<T>*, BTreeNode<T>*> BTree<T, Allocator, Stats>::split(BTreeNode<T>* x, const T& k, bool inclusive) {
+    if (x == nullptr)
+        return { nullptr, nullptr };
+
+    int n = x->n;
+    int i = inclusive ? KeySearch<T>::upperBound(x->keys, n, k)
+                      : KeySearch<T>::lowerBound(x->keys, n, k);
+
+    if (x->leaf) {
+        BTreeNode<T>* right = createNode(true);
+        for (int j = i; j < n; j++)
+            right->keys[j - i] = x->keys[j];
+        right->n = n - i;
+        x->n = i;
+        return { normalize(x), normalize(right) };
+    }
+
+    auto [childLeft, childRight] = split(x->children[i], k, inclusive);
+
+    BTreeNode<T>* right = childRight;
+    if (i < n) {
+        BTreeNode<T>* rest = createNode(false);
+        for (int j = i + 1; j < n; j++)
+            rest->keys[j - i - 1] = x->keys[j];
+        for (int j = i + 1; j <= n; j++)
+            rest->children[j - i - 1] = x->children[j];
+        rest->n = n - i - 1;
+        right = join(childRight, x->keys[i], normalize(rest));
+    }
+
+    BTreeNode<T>* left = childLeft;
+    if (i > 0) {
+        T separator = x->keys[i - 1];
+        x->n = i - 1;
+        left = join(normalize(x), separator, childLeft);
+    }
+    else {
+        destroyNode(x);
+    }
+
+    return { left, right };
+}
+
+// Removes every key in [lo, hi]. The tree is split around the range, the
+// middle piece is freed node by node without looking at its keys, and the
+// outer pieces are joined back together.
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::erase_range(const T& lo, const T& hi) {
+    if (root == nullptr || hi < lo)
+        return;
+
+    auto [left, rest] = split(root, lo, false);
+    auto [middle, right] = split(rest, hi, true);
+    clear(middle);
+
+    if (left == nullptr || right == nullptr) {
+        root = left ? left : right;
+        return;
+    }
+
+    BTreeNode<T>* cur = right;
+    while (!cur->leaf)
+        cur = cur->children[0];
+    T separator = cur->keys[0];
+    right = removeKey(right, separator);
+    root = join(left, separator, right);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline typename BTree<T, Allocator, Stats>::BulkLoadState BTree<T, Allocator, Stats>::bulkStart(double fillFactor) {
+    clear(root);
+    root = nullptr;
+
+    int capacity = 2 * t - 1;
+    int target = static_cast<int>(fillFactor * capacity + 0.5);
+    if (target < t - 1) target = t - 1;
+    if (target > capacity) target = capacity;
+
+    BulkLoadState state;
+    state.leafTarget = target;
+    state.innerTarget = target;
+    return state;
+}
+
+// Appends k to the rightmost leaf. A full leaf is closed and k becomes the
+// separator between it and a fresh leaf.
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::bulkPush(BulkLoadState& state, const T& k) {
+    if (state.spine.empty())
+        state.spine.push_back(createNode(true));
+
+    BTreeNode<T>* leaf = state.spine[0];
+    if (leaf->n < state.leafTarget) {
+        leaf->keys[leaf->n++] = k;
+        return;
+    }
+
+    BTreeNode<T>* next = createNode(true);
+    state.spine[0] = next;
+    bulkAddSeparator(state, 1, k, leaf, next);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::bulkAddSeparator(BulkLoadState& state, std::size_t level, const T& sep, BTreeNode<T>* closed, BTreeNode<T>* next) {
+    if (level == state.spine.size()) {
+        BTreeNode<T>* p = createNode(false);
+        p->children[0] = closed;
+        p->keys[0] = sep;
+        p->children[1] = next;
+        p->n = 1;
+        state.spine.push_back(p);
+        return;
+    }
+
+    BTreeNode<T>* p = state.spine[level];
+    if (p->n < state.innerTarget) {
+        p->keys[p->n] = sep;
+        p->children[p->n + 1] = next;
+        p->n++;
+        return;
+    }
+
+    BTreeNode<T>* q = createNode(false);
+    q->children[0] = next;
+    q->n = 0;
+    state.spine[level] = q;
+    bulkAddSeparator(state, level + 1, sep, p, q);
+}
+
+// Only the right spine can be underfull. Walking it top-down, each spine
+// child is topped up to t keys from its (packed) left sibling, or merged
+// into it, so a later merge below never leaves its parent short.
+template<typename T, typename Allocator, typename Stats>
+inline void BTree<T, Allocator, Stats>::bulkFinish(BulkLoadState& state) {
+    if (state.spine.empty())
+        return;
+
+    root = normalize(state.spine.back());
+    BTreeNode<T>* x = root;
+    while (x && !x->leaf) {
+        if (x->n == 0) {
+            root = x->children[0];
+            destroyNode(x);
+            x = root;
+            continue;
+        }
+
+        BTreeNode<T>* c = x->children[x->n];
+        if (c->n < t) {
+            BTreeNode<T>* sibling = x->children[x->n - 1];
+            if (sibling->n + c->n + 1 <= 2 * t - 1)
+                merge(x, x->n - 1);
+            else
+                moveRight(x, x->n - 1, t - c->n);
+            if (x->n == 0)
+                continue;
+        }
+        x = x->children[x->n];
+    }
+}
+
+template<typename T, typename Allocator, typename Stats>
+template<typename InputIt>
+inline void BTree<T, Allocator, Stats>::bulk_load(InputIt first, InputIt last, double fillFactor) {
+    BulkLoadState state = bulkStart(fillFactor);
+    for (; first != last; ++first)
+        bulkPush(state, *first);
+    bulkFinish(state);
+}
+
+template<typename T, typename Allocator, typename Stats>
+template<typename Source>
+inline void BTree<T, Allocator, Stats>::bulk_load(Source&& source, double fillFactor, std::size_t bufferSize) {
+    BulkLoadState state = bulkStart(fillFactor);
+    std::vector<T> buffer(bufferSize > 0 ? bufferSize : 1);
+    std::size_t got;
+    while ((got = source(buffer.data(), buffer.size())) > 0) {
+        for (std::size_t i = 0; i < got; i++)
+            bulkPush(state, buffer[i]);
+    }
+    bulkFinish(state);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline std::uint64_t BTree<T, Allocator, Stats>::keyCount(BTreeNode<T>* node) const {
+    if (node == nullptr)
+        return 0;
+    std::uint64_t total = node->n;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; i++)
+            total += keyCount(node->children[i]);
+    }
+    return total;
+}
+
+template<typename T, typename Allocator, typename Stats>
+template<typename F>
+inline void BTree<T, Allocator, Stats>::visit(BTreeNode<T>* node, F& f) const {
+    if (node == nullptr)
+        return;
+    for (int i = 0; i < node->n; i++) {
+        if (!node->leaf)
+            visit(node->children[i], f);
+        f(node->keys[i]);
+    }
+    if (!node->leaf)
+        visit(node->children[node->n], f);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::save(std::ostream& out) const {
+    return saveSnapshot<T>(out, keyCount(root), [this](auto&& f) { visit(root, f); });
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    return out && save(out) && out.flush();
+}
+
+// Loads into a scratch tree sharing our allocator and swaps roots only
+// once the checksum has been verified.
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::restore(SnapshotReader& in) {
+    BTree loaded(t, Allocator(keyAlloc));
+    std::uint64_t left = in.count();
+    bool ok = true;
+    loaded.bulk_load([&](T* buffer, std::size_t capacity) {
+        std::size_t got = 0;
+        for (; got < capacity && left > 0; got++, left--) {
+            if (!SnapshotCodec<T>::read(in, buffer[got])) {
+                ok = false;
+                break;
+            }
+        }
+        return got;
+    });
+    if (!ok || !in.finish())
+        return false;
+
+    std::swap(root, loaded.root);
+    return true;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::load(std::istream& in) {
+    SnapshotReader reader;
+    return reader.open(in, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool BTree<T, Allocator, Stats>::load(const std::string& path) {
+    SnapshotReader reader;
+    return reader.open(path, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline StaticSearchTree<T> BTree<T, Allocator, Stats>::freeze() const {
+    std::vector<T> keys;
+    keys.reserve(keyCount(root));
+    auto append = [&keys](const T& key) { keys.push_back(key); };
+    visit(root, append);
+    return StaticSearchTree<T>(std::move(keys));
+}
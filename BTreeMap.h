@@ -0,0 +1,702 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "TreeStats.h"
+
+// Order-preserving byte encodings of BTreeMap keys: comparing encodings
+// with memcmp (shorter first on a tie) gives the same order as comparing
+// keys. Strings are their own encoding; integers are stored big-endian,
+// signed ones with the sign bit flipped.
+template<typename K, typename = void>
+struct BTreeMapKey;
+
+template<>
+struct BTreeMapKey<std::string> {
+    static constexpr std::size_t scratchSize = 1;
+    static std::string_view encode(const std::string& key, char*) { return key; }
+    static std::string decode(std::string_view bytes) { return std::string(bytes); }
+};
+
+template<typename K>
+struct BTreeMapKey<K, std::enable_if_t<std::is_integral_v<K>>> {
+    using U = std::make_unsigned_t<K>;
+    static constexpr std::size_t scratchSize = sizeof(K);
+    static constexpr U flip = std::is_signed_v<K> ? U(1) << (8 * sizeof(K) - 1) : 0;
+
+    static std::string_view encode(K key, char* scratch) {
+        U bits = static_cast<U>(key) ^ flip;
+        for (std::size_t i = 0; i < sizeof(K); i++)
+            scratch[i] = static_cast<char>(bits >> (8 * (sizeof(K) - 1 - i)));
+        return { scratch, sizeof(K) };
+    }
+
+    static K decode(std::string_view bytes) {
+        U bits = 0;
+        for (std::size_t i = 0; i < sizeof(K); i++)
+            bits = static_cast<U>(bits << 8 | static_cast<unsigned char>(bytes[i]));
+        return static_cast<K>(bits ^ flip);
+    }
+};
+
+// How values are stored in a leaf. Trivially copyable values are copied
+// as raw bytes; strings are length-prefixed.
+template<typename V, typename = void>
+struct BTreeMapValue {
+    static_assert(std::is_trivially_copyable_v<V>, "specialize BTreeMapValue for values that are not trivially copyable");
+
+    static std::size_t size(const V&) { return sizeof(V); }
+    static std::size_t stored(const char*) { return sizeof(V); }
+    static void write(char* out, const V& value) { std::memcpy(out, &value, sizeof(V)); }
+    static void read(const char* in, V& value) { std::memcpy(&value, in, sizeof(V)); }
+};
+
+template<>
+struct BTreeMapValue<std::string> {
+    static std::size_t size(const std::string& value) { return sizeof(std::uint16_t) + value.size(); }
+
+    static std::size_t stored(const char* in) {
+        std::uint16_t length;
+        std::memcpy(&length, in, sizeof(length));
+        return sizeof(length) + length;
+    }
+
+    static void write(char* out, const std::string& value) {
+        std::uint16_t length = static_cast<std::uint16_t>(value.size());
+        std::memcpy(out, &length, sizeof(length));
+        std::memcpy(out + sizeof(length), value.data(), value.size());
+    }
+
+    static void read(const char* in, std::string& value) {
+        std::uint16_t length;
+        std::memcpy(&length, in, sizeof(length));
+        value.assign(in + sizeof(length), length);
+    }
+};
+
+// B+ tree map on slotted pages, for variable-length keys such as URLs and
+// paths. Every node is one PageSize page:
+//
+//   header | slots -->          free          <-- entries | fences
+//
+// Slots are fixed-size and sorted; each holds the entry's offset, its
+// key length and a head, the first four key bytes as a big-endian
+// integer, so most comparisons are one integer compare and never touch
+// the entry. Entries (key bytes, then the value or child pointer) are
+// packed from the end of the page. Each page also keeps its fence keys,
+// the separators bounding its key range in the parent, and strips their
+// common prefix from every key it stores: in a subtree of
+// "https://example.com/a/..." keys only the differing tails take space,
+// and heads start at the first byte that distinguishes keys.
+//
+// Inner pages hold separators with the child to their left; the child
+// right of the last separator is the page's upper child. Leaves are
+// linked in key order. Separators are truncated to the shortest prefix
+// that still separates the two leaves. Key and value together are
+// limited to maxEntrySize bytes; insert refuses longer ones. Not
+// thread-safe.
+template<typename K, typename V, std::size_t PageSize = 4096>
+class BTreeMap {
+    static_assert(PageSize >= 1024 && PageSize <= 65536, "page offsets are 16-bit");
+
+public:
+    static constexpr std::size_t maxEntrySize = PageSize / 8;
+
+private:
+    using KeyBytes = BTreeMapKey<K>;
+    using ValueBytes = BTreeMapValue<V>;
+
+    struct Page;
+
+    struct PageHeader {
+        // leaf: next leaf; inner: upper child
+        Page* link;
+        std::uint16_t count;
+        // start of the entry area, which grows down
+        std::uint16_t dataOffset;
+        // bytes of live entries and fences, to tell when compaction helps
+        std::uint16_t spaceUsed;
+        std::uint16_t prefixLength;
+        std::uint16_t lowerOffset;
+        std::uint16_t lowerLength;
+        std::uint16_t upperOffset;
+        std::uint16_t upperLength;
+        bool leaf;
+        bool hasLower;
+        bool hasUpper;
+    };
+
+    struct Slot {
+        std::uint32_t head;
+        std::uint16_t offset;
+        std::uint16_t keyLength;
+    };
+
+    struct alignas(64) Page {
+        PageHeader header;
+        char data[PageSize - sizeof(PageHeader)];
+
+        char* at(std::size_t offset) { return reinterpret_cast<char*>(this) + offset; }
+        const char* at(std::size_t offset) const { return reinterpret_cast<const char*>(this) + offset; }
+        Slot* slots() { return reinterpret_cast<Slot*>(data); }
+        const Slot* slots() const { return reinterpret_cast<const Slot*>(data); }
+
+        std::string_view lower() const { return { at(header.lowerOffset), header.lowerLength }; }
+        std::string_view upper() const { return { at(header.upperOffset), header.upperLength }; }
+        std::string_view prefix() const { return lower().substr(0, header.prefixLength); }
+        // key of slot i without the page prefix
+        std::string_view suffix(int i) const { return { at(slots()[i].offset), slots()[i].keyLength }; }
+        const char* payload(int i) const { return at(slots()[i].offset) + slots()[i].keyLength; }
+        Page* child(int i) const;
+        void setChild(int i, Page* child);
+
+        std::size_t freeSpace() const { return header.dataOffset - sizeof(PageHeader) - header.count * sizeof(Slot); }
+        // free space once the entries are compacted
+        std::size_t freeAfterCompaction() const { return PageSize - sizeof(PageHeader) - header.count * sizeof(Slot) - header.spaceUsed; }
+    };
+
+    static_assert(sizeof(Page) == PageSize);
+
+    // A decoded entry, while pages are split, merged or compacted
+    struct Entry {
+        std::string key;
+        std::string payload;
+    };
+
+    struct PathStep {
+        Page* page;
+        int pos;
+    };
+
+    Page* root;
+    std::size_t count;
+    std::size_t pageCount;
+
+    static std::uint32_t head(std::string_view bytes);
+    static int compare(const Page* page, int slot, std::string_view suffix, std::uint32_t keyHead);
+    static int lowerBound(const Page* page, std::string_view key, bool& found);
+    static std::size_t payloadSize(const Page* page, int i);
+
+    Page* newPage();
+    void freePage(Page* page);
+    void clear(Page* page);
+
+    static void build(Page* page, bool leaf, const std::string_view* lower, const std::string_view* upper,
+                      const Entry* entries, std::size_t n, Page* link);
+    static std::size_t buildSize(const std::string_view* lower, const std::string_view* upper, const Entry* entries, std::size_t n);
+    static std::vector<Entry> entries(const Page* page);
+    static void insertAt(Page* page, int pos, std::string_view key, const char* payload, std::size_t payloadLength);
+    static void eraseAt(Page* page, int pos);
+    static void compact(Page* page);
+
+    Page* descend(std::string_view key, std::vector<PathStep>& path) const;
+    bool split(std::vector<PathStep>& path, std::size_t level);
+    void merge(std::vector<PathStep>& path, std::size_t level);
+    template<typename F>
+    void scan(const K* lo, const K* hi, F& f) const;
+
+public:
+    BTreeMap() : root(nullptr), count(0), pageCount(0) {}
+    BTreeMap(const BTreeMap&) = delete;
+    BTreeMap& operator=(const BTreeMap&) = delete;
+    ~BTreeMap() { clear(root); }
+
+    // False if key is already present or key and value exceed maxEntrySize
+    bool insert(const K& key, const V& value);
+    bool remove(const K& key);
+    bool find(const K& key, V& value) const;
+    bool contains(const K& key) const;
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Calls f(key, value) in ascending key order, over everything or over
+    // the keys in [lo, hi]
+    template<typename F>
+    void for_each(F&& f) const { scan(nullptr, nullptr, f); }
+    template<typename F>
+    void for_each_range(const K& lo, const K& hi, F&& f) const { scan(&lo, &hi, f); }
+
+    // Pages and their free bytes
+    MemoryFootprint memory_footprint() const;
+};
+
+template<typename K, typename V, std::size_t PageSize>
+inline typename BTreeMap<K, V, PageSize>::Page* BTreeMap<K, V, PageSize>::Page::child(int i) const {
+    if (i == header.count)
+        return header.link;
+    Page* child;
+    std::memcpy(&child, payload(i), sizeof(child));
+    return child;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::Page::setChild(int i, Page* child) {
+    if (i == header.count)
+        header.link = child;
+    else
+        std::memcpy(at(slots()[i].offset) + slots()[i].keyLength, &child, sizeof(child));
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline std::uint32_t BTreeMap<K, V, PageSize>::head(std::string_view bytes) {
+    std::uint32_t h = 0;
+    for (std::size_t i = 0; i < 4; i++)
+        h = h << 8 | (i < bytes.size() ? static_cast<unsigned char>(bytes[i]) : 0u);
+    return h;
+}
+
+// Heads differ: they decide. Equal: compare the whole suffixes, since a
+// head pads short keys with zeros.
+template<typename K, typename V, std::size_t PageSize>
+inline int BTreeMap<K, V, PageSize>::compare(const Page* page, int slot, std::string_view suffix, std::uint32_t keyHead) {
+    std::uint32_t h = page->slots()[slot].head;
+    if (h != keyHead)
+        return h < keyHead ? -1 : 1;
+    return page->suffix(slot).compare(suffix);
+}
+
+// Position of the first slot not below key; key must lie within the
+// page's fences, and so start with its prefix.
+template<typename K, typename V, std::size_t PageSize>
+inline int BTreeMap<K, V, PageSize>::lowerBound(const Page* page, std::string_view key, bool& found) {
+    std::string_view suffix = key.substr(page->header.prefixLength);
+    std::uint32_t keyHead = head(suffix);
+    int lo = 0, hi = page->header.count;
+    found = false;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int c = compare(page, mid, suffix, keyHead);
+        if (c < 0) {
+            lo = mid + 1;
+        }
+        else {
+            if (c == 0)
+                found = true;
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline std::size_t BTreeMap<K, V, PageSize>::payloadSize(const Page* page, int i) {
+    return page->header.leaf ? ValueBytes::stored(page->payload(i)) : sizeof(Page*);
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline typename BTreeMap<K, V, PageSize>::Page* BTreeMap<K, V, PageSize>::newPage() {
+    pageCount++;
+    return static_cast<Page*>(::operator new(sizeof(Page), std::align_val_t(alignof(Page))));
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::freePage(Page* page) {
+    pageCount--;
+    ::operator delete(page, std::align_val_t(alignof(Page)));
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::clear(Page* page) {
+    if (page == nullptr)
+        return;
+    if (!page->header.leaf) {
+        for (int i = 0; i <= page->header.count; i++)
+            clear(page->child(i));
+    }
+    freePage(page);
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline std::size_t BTreeMap<K, V, PageSize>::buildSize(const std::string_view* lower, const std::string_view* upper, const Entry* entries, std::size_t n) {
+    std::size_t prefix = 0;
+    if (lower && upper)
+        prefix = std::mismatch(lower->begin(), lower->end(), upper->begin(), upper->end()).first - lower->begin();
+
+    std::size_t bytes = sizeof(PageHeader) + (lower ? lower->size() : 0) + (upper ? upper->size() : 0);
+    for (std::size_t i = 0; i < n; i++)
+        bytes += sizeof(Slot) + entries[i].key.size() - prefix + entries[i].payload.size();
+    return bytes;
+}
+
+// Lays out a page from scratch: fences at the very end, entries below
+// them, all without the common prefix of the fences.
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::build(Page* page, bool leaf, const std::string_view* lower, const std::string_view* upper,
+                                            const Entry* entries, std::size_t n, Page* link) {
+    PageHeader& h = page->header;
+    h = PageHeader{};
+    h.link = link;
+    h.leaf = leaf;
+    h.dataOffset = static_cast<std::uint16_t>(PageSize);
+
+    auto put = [&](std::string_view bytes) {
+        h.dataOffset = static_cast<std::uint16_t>(h.dataOffset - bytes.size());
+        std::memcpy(page->at(h.dataOffset), bytes.data(), bytes.size());
+        h.spaceUsed = static_cast<std::uint16_t>(h.spaceUsed + bytes.size());
+        return h.dataOffset;
+    };
+    if (lower) {
+        h.hasLower = true;
+        h.lowerLength = static_cast<std::uint16_t>(lower->size());
+        h.lowerOffset = put(*lower);
+    }
+    if (upper) {
+        h.hasUpper = true;
+        h.upperLength = static_cast<std::uint16_t>(upper->size());
+        h.upperOffset = put(*upper);
+    }
+    if (lower && upper)
+        h.prefixLength = static_cast<std::uint16_t>(std::mismatch(lower->begin(), lower->end(), upper->begin(), upper->end()).first - lower->begin());
+
+    for (std::size_t i = 0; i < n; i++)
+        insertAt(page, static_cast<int>(i), entries[i].key, entries[i].payload.data(), entries[i].payload.size());
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline std::vector<typename BTreeMap<K, V, PageSize>::Entry> BTreeMap<K, V, PageSize>::entries(const Page* page) {
+    std::vector<Entry> result(page->header.count);
+    std::string_view prefix = page->prefix();
+    for (int i = 0; i < page->header.count; i++) {
+        result[i].key.reserve(prefix.size() + page->slots()[i].keyLength);
+        result[i].key.append(prefix).append(page->suffix(i));
+        result[i].payload.assign(page->payload(i), payloadSize(page, i));
+    }
+    return result;
+}
+
+// Caller checks freeSpace()
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::insertAt(Page* page, int pos, std::string_view key, const char* payload, std::size_t payloadLength) {
+    PageHeader& h = page->header;
+    std::string_view suffix = key.substr(h.prefixLength);
+    std::size_t length = suffix.size() + payloadLength;
+
+    h.dataOffset = static_cast<std::uint16_t>(h.dataOffset - length);
+    std::memcpy(page->at(h.dataOffset), suffix.data(), suffix.size());
+    std::memcpy(page->at(h.dataOffset) + suffix.size(), payload, payloadLength);
+    h.spaceUsed = static_cast<std::uint16_t>(h.spaceUsed + length);
+
+    Slot* slots = page->slots();
+    std::memmove(slots + pos + 1, slots + pos, (h.count - pos) * sizeof(Slot));
+    slots[pos] = Slot{ head(suffix), h.dataOffset, static_cast<std::uint16_t>(suffix.size()) };
+    h.count++;
+}
+
+// The entry's bytes become a hole until the next compaction
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::eraseAt(Page* page, int pos) {
+    PageHeader& h = page->header;
+    h.spaceUsed = static_cast<std::uint16_t>(h.spaceUsed - page->slots()[pos].keyLength - payloadSize(page, pos));
+    Slot* slots = page->slots();
+    std::memmove(slots + pos, slots + pos + 1, (h.count - pos - 1) * sizeof(Slot));
+    h.count--;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::compact(Page* page) {
+    Page scratch;
+    std::vector<Entry> all = entries(page);
+    std::string lower(page->lower()), upper(page->upper());
+    std::string_view lowerView(lower), upperView(upper);
+    build(&scratch, page->header.leaf, page->header.hasLower ? &lowerView : nullptr, page->header.hasUpper ? &upperView : nullptr,
+          all.data(), all.size(), page->header.link);
+    std::memcpy(static_cast<void*>(page), &scratch, sizeof(Page));
+}
+
+// Walks to the leaf for key, recording each inner page and the child
+// taken.
+template<typename K, typename V, std::size_t PageSize>
+inline typename BTreeMap<K, V, PageSize>::Page* BTreeMap<K, V, PageSize>::descend(std::string_view key, std::vector<PathStep>& path) const {
+    path.clear();
+    Page* page = root;
+    while (!page->header.leaf) {
+        bool found;
+        int pos = lowerBound(page, key, found);
+        path.push_back({ page, pos });
+        page = page->child(pos);
+    }
+    return page;
+}
+
+// Splits the page at path level (path.size() is the leaf) and posts the
+// separator to its parent. If the parent has no room, splits the parent
+// instead and returns false; the caller descends again either way.
+template<typename K, typename V, std::size_t PageSize>
+inline bool BTreeMap<K, V, PageSize>::split(std::vector<PathStep>& path, std::size_t level) {
+    Page* page = level == path.size() ? nullptr : path[level].page;
+    if (page == nullptr) {
+        // the leaf is the child taken at the last step
+        page = path.empty() ? root : path.back().page->child(path.back().pos);
+    }
+
+    Page* parent;
+    int pos;
+    if (level == 0) {
+        parent = newPage();
+        build(parent, false, nullptr, nullptr, nullptr, 0, page);
+        root = parent;
+        pos = 0;
+    }
+    else {
+        parent = path[level - 1].page;
+        pos = path[level - 1].pos;
+    }
+
+    bool leaf = page->header.leaf;
+    std::vector<Entry> all = entries(page);
+    std::size_t n = all.size();
+
+    // cut where the left half holds about half the bytes
+    std::size_t total = 0;
+    for (const Entry& e : all)
+        total += e.key.size() + e.payload.size();
+    std::size_t cut = 0, bytes = 0;
+    while (cut + 1 < n && bytes + all[cut].key.size() + all[cut].payload.size() <= total / 2) {
+        bytes += all[cut].key.size() + all[cut].payload.size();
+        cut++;
+    }
+    cut = std::clamp<std::size_t>(cut, 1, leaf ? n - 1 : n - 2);
+
+    std::string separator;
+    if (leaf) {
+        // shortest prefix of the right half's first key that is still
+        // above the left half's last key
+        const std::string& left = all[cut - 1].key;
+        const std::string& right = all[cut].key;
+        std::size_t common = std::mismatch(left.begin(), left.end(), right.begin(), right.end()).first - left.begin();
+        separator = common + 1 < right.size() ? right.substr(0, common + 1) : left;
+    }
+    else {
+        separator = all[cut].key;
+    }
+
+    std::size_t need = sizeof(Slot) + separator.size() - parent->header.prefixLength + sizeof(Page*);
+    if (parent->freeSpace() < need) {
+        if (parent->freeAfterCompaction() >= need) {
+            compact(parent);
+        }
+        else {
+            split(path, level - 1);
+            return false;
+        }
+    }
+
+    std::string lower(page->lower()), upper(page->upper());
+    std::string_view lowerView(lower), upperView(upper), separatorView(separator);
+    const std::string_view* lowerFence = page->header.hasLower ? &lowerView : nullptr;
+    const std::string_view* upperFence = page->header.hasUpper ? &upperView : nullptr;
+
+    Page* right = newPage();
+    if (leaf) {
+        build(right, true, &separatorView, upperFence, all.data() + cut, n - cut, page->header.link);
+        build(page, true, lowerFence, &separatorView, all.data(), cut, right);
+    }
+    else {
+        Page* middle;
+        std::memcpy(&middle, all[cut].payload.data(), sizeof(middle));
+        build(right, false, &separatorView, upperFence, all.data() + cut + 1, n - cut - 1, page->header.link);
+        build(page, false, lowerFence, &separatorView, all.data(), cut, middle);
+    }
+
+    parent->setChild(pos, right);
+    std::string payload(sizeof(Page*), '\0');
+    std::memcpy(payload.data(), &page, sizeof(page));
+    insertAt(parent, pos, separator, payload.data(), payload.size());
+    return true;
+}
+
+// Merges the page at path level with a sibling when both fit in one
+// page, then does the same for the parent if that left it sparse.
+template<typename K, typename V, std::size_t PageSize>
+inline void BTreeMap<K, V, PageSize>::merge(std::vector<PathStep>& path, std::size_t level) {
+    if (level == 0)
+        return;
+    Page* parent = path[level - 1].page;
+    if (parent->header.count == 0)
+        return;
+    int j = std::min<int>(path[level - 1].pos, parent->header.count - 1);
+    Page* left = parent->child(j);
+    Page* right = parent->child(j + 1);
+    bool leaf = left->header.leaf;
+
+    std::vector<Entry> all = entries(left);
+    if (!leaf) {
+        // the separator comes down, pointing at the left page's upper child
+        Entry down;
+        down.key.append(parent->prefix()).append(parent->suffix(j));
+        down.payload.assign(sizeof(Page*), '\0');
+        Page* upperChild = left->header.link;
+        std::memcpy(down.payload.data(), &upperChild, sizeof(upperChild));
+        all.push_back(std::move(down));
+    }
+    std::vector<Entry> rest = entries(right);
+    all.insert(all.end(), std::make_move_iterator(rest.begin()), std::make_move_iterator(rest.end()));
+
+    std::string lower(left->lower()), upper(right->upper());
+    std::string_view lowerView(lower), upperView(upper);
+    const std::string_view* lowerFence = left->header.hasLower ? &lowerView : nullptr;
+    const std::string_view* upperFence = right->header.hasUpper ? &upperView : nullptr;
+    if (buildSize(lowerFence, upperFence, all.data(), all.size()) > PageSize)
+        return;
+
+    build(left, leaf, lowerFence, upperFence, all.data(), all.size(), right->header.link);
+    freePage(right);
+    eraseAt(parent, j);
+    parent->setChild(j, left);
+
+    if (parent == root && parent->header.count == 0) {
+        root = parent->header.link;
+        freePage(parent);
+        return;
+    }
+    if (parent->header.spaceUsed < PageSize / 4)
+        merge(path, level - 1);
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline bool BTreeMap<K, V, PageSize>::insert(const K& key, const V& value) {
+    char scratch[KeyBytes::scratchSize];
+    std::string_view bytes = KeyBytes::encode(key, scratch);
+    std::size_t valueSize = ValueBytes::size(value);
+    if (bytes.size() + valueSize > maxEntrySize)
+        return false;
+
+    if (root == nullptr) {
+        root = newPage();
+        build(root, true, nullptr, nullptr, nullptr, 0, nullptr);
+    }
+
+    std::vector<PathStep> path;
+    while (true) {
+        Page* leaf = descend(bytes, path);
+        bool found;
+        int pos = lowerBound(leaf, bytes, found);
+        if (found)
+            return false;
+
+        std::size_t need = sizeof(Slot) + bytes.size() - leaf->header.prefixLength + valueSize;
+        if (leaf->freeSpace() < need && leaf->freeAfterCompaction() >= need)
+            compact(leaf);
+        if (leaf->freeSpace() >= need) {
+            char payload[maxEntrySize];
+            ValueBytes::write(payload, value);
+            insertAt(leaf, pos, bytes, payload, valueSize);
+            count++;
+            return true;
+        }
+        split(path, path.size());
+    }
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline bool BTreeMap<K, V, PageSize>::remove(const K& key) {
+    if (root == nullptr)
+        return false;
+    char scratch[KeyBytes::scratchSize];
+    std::string_view bytes = KeyBytes::encode(key, scratch);
+
+    std::vector<PathStep> path;
+    Page* leaf = descend(bytes, path);
+    bool found;
+    int pos = lowerBound(leaf, bytes, found);
+    if (!found)
+        return false;
+
+    eraseAt(leaf, pos);
+    count--;
+    if (leaf->header.spaceUsed < PageSize / 4)
+        merge(path, path.size());
+    if (count == 0) {
+        clear(root);
+        root = nullptr;
+    }
+    return true;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline bool BTreeMap<K, V, PageSize>::find(const K& key, V& value) const {
+    if (root == nullptr)
+        return false;
+    char scratch[KeyBytes::scratchSize];
+    std::string_view bytes = KeyBytes::encode(key, scratch);
+
+    const Page* page = root;
+    bool found;
+    while (!page->header.leaf)
+        page = page->child(lowerBound(page, bytes, found));
+    int pos = lowerBound(page, bytes, found);
+    if (found)
+        ValueBytes::read(page->payload(pos), value);
+    return found;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline bool BTreeMap<K, V, PageSize>::contains(const K& key) const {
+    if (root == nullptr)
+        return false;
+    char scratch[KeyBytes::scratchSize];
+    std::string_view bytes = KeyBytes::encode(key, scratch);
+
+    const Page* page = root;
+    bool found;
+    while (!page->header.leaf)
+        page = page->child(lowerBound(page, bytes, found));
+    lowerBound(page, bytes, found);
+    return found;
+}
+
+template<typename K, typename V, std::size_t PageSize>
+template<typename F>
+inline void BTreeMap<K, V, PageSize>::scan(const K* lo, const K* hi, F& f) const {
+    if (root == nullptr)
+        return;
+    char loScratch[KeyBytes::scratchSize], hiScratch[KeyBytes::scratchSize];
+    std::string_view loBytes = lo ? KeyBytes::encode(*lo, loScratch) : std::string_view();
+    std::string_view hiBytes = hi ? KeyBytes::encode(*hi, hiScratch) : std::string_view();
+    if (lo && hi && hiBytes < loBytes)
+        return;
+
+    const Page* page = root;
+    bool found;
+    while (!page->header.leaf)
+        page = page->child(lo ? lowerBound(page, loBytes, found) : 0);
+    int pos = lo ? lowerBound(page, loBytes, found) : 0;
+
+    std::string key;
+    V value;
+    for (; page != nullptr; page = page->header.link, pos = 0) {
+        std::string_view prefix = page->prefix();
+        for (; pos < page->header.count; pos++) {
+            key.assign(prefix).append(page->suffix(pos));
+            if (hi && hiBytes < key)
+                return;
+            ValueBytes::read(page->payload(pos), value);
+            f(KeyBytes::decode(key), static_cast<const V&>(value));
+        }
+    }
+}
+
+template<typename K, typename V, std::size_t PageSize>
+inline MemoryFootprint BTreeMap<K, V, PageSize>::memory_footprint() const {
+    MemoryFootprint total{ pageCount * PageSize, 0 };
+    std::vector<const Page*> stack;
+    if (root)
+        stack.push_back(root);
+    while (!stack.empty()) {
+        const Page* page = stack.back();
+        stack.pop_back();
+        total.slack += page->freeAfterCompaction();
+        if (!page->header.leaf) {
+            for (int i = 0; i <= page->header.count; i++)
+                stack.push_back(page->child(i));
+        }
+    }
+    return total;
+}
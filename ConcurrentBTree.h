@@ -0,0 +1,311 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <type_traits>
+#include "KeySearch.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Node latch for optimistic lock coupling. Readers never write to it: they
+// remember the version, read the node and validate the version afterwards.
+// Writers set the lock bit (2) by bumping an unchanged version, and bump it
+// again to unlock, so every write is visible to readers as a new version.
+class OptimisticLatch {
+public:
+    OptimisticLatch() : version(0) {}
+
+    std::uint64_t readLockOrRestart(bool& restart) const {
+        std::uint64_t v = version.load(std::memory_order_acquire);
+        if (v & locked) {
+            pause();
+            restart = true;
+        }
+        return v;
+    }
+
+    void checkOrRestart(std::uint64_t v, bool& restart) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version.load(std::memory_order_relaxed) != v)
+            restart = true;
+    }
+
+    void upgradeToWriteLockOrRestart(std::uint64_t& v, bool& restart) {
+        if (version.compare_exchange_strong(v, v + locked, std::memory_order_acquire))
+            v += locked;
+        else
+            restart = true;
+    }
+
+    void writeUnlock() {
+        version.fetch_add(locked, std::memory_order_release);
+    }
+
+private:
+    static constexpr std::uint64_t locked = 2;
+
+    static void pause() {
+#if defined(__SSE2__) || defined(_M_X64)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    std::atomic<std::uint64_t> version;
+};
+
+// Thread-safe BTree with optimistic lock coupling. Inserts split full nodes
+// eagerly on the way down (as BTree::insertNonFull does), locking only the
+// node being split and its parent, then restart. Lookups take no locks at
+// all and retry if a node they read was modified underneath them. Nodes are
+// never freed while the tree is alive, so a stale child pointer is always
+// safe to follow until validation rejects it. Keys a writer may be shifting
+// are only touched through atomic_ref, so optimistic reads are race-free.
+// There is no remove(): deleting without rebalancing would leave empty
+// leaves under separators that no longer exist.
+template <typename T, int t = 16>
+class ConcurrentBTree {
+    static_assert(t >= 2, "minimum degree must be at least 2");
+    static_assert(std::is_trivially_copyable_v<T>, "keys are read optimistically and must be trivially copyable");
+
+private:
+    struct Node {
+        OptimisticLatch latch;
+        std::atomic<int> n;
+        const bool leaf;
+        alignas(std::atomic_ref<T>::required_alignment) T keys[2 * t - 1];
+        std::atomic<Node*> children[2 * t];
+
+        explicit Node(bool isLeaf) : n(0), leaf(isLeaf) {}
+
+        int count() const {
+            int c = n.load(std::memory_order_relaxed);
+            return c < 0 ? 0 : (c > 2 * t - 1 ? 2 * t - 1 : c);
+        }
+
+        T key(int i) { return std::atomic_ref<T>(keys[i]).load(std::memory_order_relaxed); }
+        void setKey(int i, const T& k) { std::atomic_ref<T>(keys[i]).store(k, std::memory_order_relaxed); }
+
+        // Copies the keys out for KeySearch. The copy means nothing until
+        // the version has been validated.
+        int loadKeys(T* out) {
+            int c = count();
+            for (int i = 0; i < c; i++)
+                out[i] = key(i);
+            return c;
+        }
+
+        // release/acquire so a new node's contents are visible once it is linked
+        Node* child(int i) const { return children[i].load(std::memory_order_acquire); }
+        void setChild(int i, Node* c) { children[i].store(c, std::memory_order_release); }
+    };
+
+    std::atomic<Node*> root;
+
+    void splitChild(Node* x, int i, Node* y);
+    void splitRoot(Node* y);
+    void clear(Node* node);
+    void traverse(Node* node, std::ostream& out) const;
+
+public:
+    ConcurrentBTree() : root(new Node(true)) {}
+    ConcurrentBTree(const ConcurrentBTree&) = delete;
+    ConcurrentBTree& operator=(const ConcurrentBTree&) = delete;
+
+    ~ConcurrentBTree() {
+        clear(root.load());
+    }
+
+    void insert(const T& k);
+    bool search(const T& k) const;
+    void traverse(std::ostream& out = std::cout) const;
+};
+
+// Moves the upper half of the full node y (children[i] of x) into a new
+// right sibling and its median into x. Caller holds both write locks.
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::splitChild(Node* x, int i, Node* y) {
+    Node* z = new Node(y->leaf);
+
+    for (int j = 0; j < t - 1; j++)
+        z->setKey(j, y->keys[j + t]);
+
+    if (!y->leaf) {
+        for (int j = 0; j < t; j++)
+            z->setChild(j, y->child(j + t));
+    }
+    z->n.store(t - 1, std::memory_order_relaxed);
+
+    int n = x->count();
+    for (int j = n; j >= i + 1; j--)
+        x->setChild(j + 1, x->child(j));
+    x->setChild(i + 1, z);
+
+    for (int j = n - 1; j >= i; j--)
+        x->setKey(j + 1, x->keys[j]);
+    x->setKey(i, y->keys[t - 1]);
+    x->n.store(n + 1, std::memory_order_relaxed);
+
+    y->n.store(t - 1, std::memory_order_relaxed);
+}
+
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::splitRoot(Node* y) {
+    Node* s = new Node(false);
+    s->setChild(0, y);
+    splitChild(s, 0, y);
+    root.store(s, std::memory_order_release);
+}
+
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::insert(const T& k) {
+retry:
+    bool restart = false;
+    Node* node = root.load(std::memory_order_acquire);
+    std::uint64_t v = node->latch.readLockOrRestart(restart);
+    if (restart || node != root.load(std::memory_order_acquire))
+        goto retry;
+
+    {
+        Node* parent = nullptr;
+        std::uint64_t pv = 0;
+        int slot = 0;
+
+        while (true) {
+            if (node->count() == 2 * t - 1) {
+                if (parent) {
+                    parent->latch.upgradeToWriteLockOrRestart(pv, restart);
+                    if (restart) goto retry;
+                }
+                node->latch.upgradeToWriteLockOrRestart(v, restart);
+                if (restart) {
+                    if (parent) parent->latch.writeUnlock();
+                    goto retry;
+                }
+                if (!parent && node != root.load(std::memory_order_acquire)) {
+                    node->latch.writeUnlock();
+                    goto retry;
+                }
+
+                if (parent)
+                    splitChild(parent, slot, node);
+                else
+                    splitRoot(node);
+
+                node->latch.writeUnlock();
+                if (parent) parent->latch.writeUnlock();
+                goto retry;
+            }
+
+            if (node->leaf) {
+                node->latch.upgradeToWriteLockOrRestart(v, restart);
+                if (restart) goto retry;
+                if (parent) {
+                    parent->latch.checkOrRestart(pv, restart);
+                    if (restart) {
+                        node->latch.writeUnlock();
+                        goto retry;
+                    }
+                }
+
+                int n = node->count();
+                int i = KeySearch<T>::upperBound(node->keys, n, k);
+                for (int j = n; j > i; j--)
+                    node->setKey(j, node->keys[j - 1]);
+                node->setKey(i, k);
+                node->n.store(n + 1, std::memory_order_relaxed);
+                node->latch.writeUnlock();
+                return;
+            }
+
+            T copy[2 * t - 1];
+            int i = KeySearch<T>::upperBound(copy, node->loadKeys(copy), k);
+            Node* child = node->child(i);
+            node->latch.checkOrRestart(v, restart);
+            if (restart) goto retry;
+            if (parent) {
+                parent->latch.checkOrRestart(pv, restart);
+                if (restart) goto retry;
+            }
+
+            std::uint64_t cv = child->latch.readLockOrRestart(restart);
+            if (restart) goto retry;
+
+            parent = node;
+            pv = v;
+            slot = i;
+            node = child;
+            v = cv;
+        }
+    }
+}
+
+template<typename T, int t>
+inline bool ConcurrentBTree<T, t>::search(const T& k) const {
+retry:
+    bool restart = false;
+    Node* node = root.load(std::memory_order_acquire);
+    std::uint64_t v = node->latch.readLockOrRestart(restart);
+    if (restart || node != root.load(std::memory_order_acquire))
+        goto retry;
+
+    while (true) {
+        T copy[2 * t - 1];
+        int n = node->loadKeys(copy);
+        int i = KeySearch<T>::lowerBound(copy, n, k);
+        bool found = i < n && copy[i] == k;
+        Node* child = node->leaf ? nullptr : node->child(i);
+
+        node->latch.checkOrRestart(v, restart);
+        if (restart) goto retry;
+
+        if (found) return true;
+        if (!child) return false;
+
+        // the parent must still be unchanged once the child's version is
+        // known, otherwise the child may have been split in between
+        std::uint64_t cv = child->latch.readLockOrRestart(restart);
+        if (restart) goto retry;
+        node->latch.checkOrRestart(v, restart);
+        if (restart) goto retry;
+        node = child;
+        v = cv;
+    }
+}
+
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::clear(Node* node) {
+    if (!node) return;
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count(); i++)
+            clear(node->child(i));
+    }
+    delete node;
+}
+
+// Not thread-safe; intended for debugging a quiescent tree.
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::traverse(Node* node, std::ostream& out) const {
+    int i;
+    for (i = 0; i < node->count(); i++) {
+        if (!node->leaf)
+            traverse(node->child(i), out);
+        out << " " << node->keys[i];
+    }
+    if (!node->leaf)
+        traverse(node->child(i), out);
+}
+
+template<typename T, int t>
+inline void ConcurrentBTree<T, t>::traverse(std::ostream& out) const {
+    Node* r = root.load();
+    if (r->count() == 0)
+        out << "Tree is empty\n";
+    else
+        traverse(r, out);
+}
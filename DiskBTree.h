@@ -0,0 +1,559 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "KeySearch.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+// Fixed-size pages in a single file, addressed by page id. read, write and
+// sync return false on an I/O error; read also fails on a page that is not
+// wholly in the file, so a truncated file is never parsed as empty nodes.
+class PageFile {
+public:
+    PageFile(const std::string& path, std::uint32_t pageSize);
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    ~PageFile() {
+        if (file)
+            std::fclose(file);
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    bool isNew() const { return created; }
+    std::uint32_t pageSize() const { return size; }
+
+    bool read(std::uint32_t id, char* buffer);
+    bool write(std::uint32_t id, const char* buffer);
+    // Pushes written pages through the stdio buffer and the OS cache to
+    // the device.
+    bool sync();
+
+private:
+    bool seek(std::uint64_t offset, int origin);
+
+    std::FILE* file;
+    std::uint32_t size;
+    bool created;
+};
+
+inline PageFile::PageFile(const std::string& path, std::uint32_t pageSize) : file(nullptr), size(pageSize), created(false) {
+    file = std::fopen(path.c_str(), "r+b");
+    if (!file) {
+        file = std::fopen(path.c_str(), "w+b");
+        created = file != nullptr;
+    }
+    else if (seek(0, SEEK_END)) {
+        created = std::ftell(file) == 0;
+    }
+}
+
+inline bool PageFile::seek(std::uint64_t offset, int origin) {
+#if defined(_WIN32)
+    return _fseeki64(file, static_cast<__int64>(offset), origin) == 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#else
+    return std::fseek(file, static_cast<long>(offset), origin) == 0;
+#endif
+}
+
+inline bool PageFile::read(std::uint32_t id, char* buffer) {
+    return seek(static_cast<std::uint64_t>(id) * size, SEEK_SET)
+        && std::fread(buffer, 1, size, file) == size;
+}
+
+inline bool PageFile::write(std::uint32_t id, const char* buffer) {
+    return seek(static_cast<std::uint64_t>(id) * size, SEEK_SET)
+        && std::fwrite(buffer, 1, size, file) == size;
+}
+
+inline bool PageFile::sync() {
+    if (std::fflush(file) != 0)
+        return false;
+#if defined(_WIN32)
+    return _commit(_fileno(file)) == 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    return fsync(fileno(file)) == 0;
+#else
+    return true;
+#endif
+}
+
+// Caches pages of a PageFile in a fixed number of frames. Pinned frames are
+// never evicted; the rest are replaced with the clock algorithm and written
+// back if dirty. pin and pinNew return nullptr when every frame is pinned or
+// the page cannot be read or a dirty victim cannot be written back.
+class BufferPool {
+public:
+    BufferPool(PageFile& file, std::size_t frameCount);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* pin(std::uint32_t id);
+    char* pinNew(std::uint32_t id);
+    void unpin(std::uint32_t id, bool dirty);
+    bool flush();
+
+    std::size_t frames() const { return table.size(); }
+    std::size_t misses() const { return missCount; }
+
+private:
+    struct Frame {
+        std::uint32_t page;
+        int pins;
+        bool dirty;
+        bool referenced;
+        bool used;
+    };
+
+    std::size_t victim();
+    char* data(std::size_t frame) { return memory.get() + frame * file.pageSize(); }
+
+    struct AlignedDelete {
+        void operator()(char* p) const { ::operator delete[](p, std::align_val_t(64)); }
+    };
+
+    PageFile& file;
+    std::unique_ptr<char[], AlignedDelete> memory;
+    std::vector<Frame> table;
+    std::unordered_map<std::uint32_t, std::size_t> resident;
+    std::size_t hand;
+    std::size_t missCount;
+};
+
+inline BufferPool::BufferPool(PageFile& pageFile, std::size_t frameCount)
+    : file(pageFile), table(frameCount), hand(0), missCount(0) {
+    memory.reset(static_cast<char*>(::operator new[](frameCount * file.pageSize(), std::align_val_t(64))));
+    for (Frame& f : table)
+        f = Frame{ 0, 0, false, false, false };
+}
+
+inline std::size_t BufferPool::victim() {
+    for (std::size_t sweep = 0; sweep < 2 * table.size() + 1; sweep++) {
+        std::size_t i = hand;
+        hand = (hand + 1) % table.size();
+        Frame& f = table[i];
+        if (!f.used)
+            return i;
+        if (f.pins > 0)
+            continue;
+        if (f.referenced) {
+            f.referenced = false;
+            continue;
+        }
+        if (f.dirty && !file.write(f.page, data(i)))
+            return table.size();
+        resident.erase(f.page);
+        f.used = false;
+        return i;
+    }
+    return table.size();
+}
+
+inline char* BufferPool::pin(std::uint32_t id) {
+    auto it = resident.find(id);
+    if (it != resident.end()) {
+        Frame& f = table[it->second];
+        f.pins++;
+        f.referenced = true;
+        return data(it->second);
+    }
+
+    std::size_t i = victim();
+    if (i == table.size())
+        return nullptr;
+    missCount++;
+    if (!file.read(id, data(i)))
+        return nullptr;
+    table[i] = Frame{ id, 1, false, true, true };
+    resident[id] = i;
+    return data(i);
+}
+
+// Pins a page that has never been written; its contents start zeroed.
+inline char* BufferPool::pinNew(std::uint32_t id) {
+    std::size_t i = victim();
+    if (i == table.size())
+        return nullptr;
+    std::memset(data(i), 0, file.pageSize());
+    table[i] = Frame{ id, 1, true, true, true };
+    resident[id] = i;
+    return data(i);
+}
+
+inline void BufferPool::unpin(std::uint32_t id, bool dirty) {
+    Frame& f = table[resident[id]];
+    f.pins--;
+    f.dirty = f.dirty || dirty;
+}
+
+// Pages that fail to write stay dirty.
+inline bool BufferPool::flush() {
+    bool ok = true;
+    for (std::size_t i = 0; i < table.size(); i++) {
+        if (table[i].used && table[i].dirty) {
+            if (file.write(table[i].page, data(i)))
+                table[i].dirty = false;
+            else
+                ok = false;
+        }
+    }
+    return ok;
+}
+
+// BTree over a PageFile. Nodes are pages, children are page ids, and only
+// the pages held by the buffer pool are in memory. Page 0 is the header;
+// flush() writes every dirty page, syncs, then writes and syncs the header,
+// after which the file can be reopened without rebuilding anything.
+//
+// The file is only consistent right after a successful flush(). Evicting a
+// dirty page overwrites it in place, so after a crash between flushes the
+// pages on disk may no longer match the header and the file must be
+// rebuilt. An I/O error closes the tree: the failing call returns false,
+// isOpen() turns false and nothing more is written.
+template <typename T>
+class DiskBTree {
+    static_assert(std::is_trivially_copyable_v<T>, "DiskBTree keys are stored as raw bytes");
+
+public:
+    DiskBTree(const std::string& path, std::size_t memoryBudget = 64u << 20, std::uint32_t pageSize = 4096);
+    DiskBTree(const DiskBTree&) = delete;
+    DiskBTree& operator=(const DiskBTree&) = delete;
+
+    ~DiskBTree() {
+        flush();
+    }
+
+    bool isOpen() const { return open; }
+    bool search(const T& k);
+    bool insert(const T& k);
+    void traverse();
+    bool flush();
+    std::uint64_t size() const { return header.count; }
+    int degree() const { return t; }
+    const BufferPool& bufferPool() const { return *pool; }
+
+private:
+    static constexpr std::uint32_t magic = 0x54424c54; // "TLBT"
+    static constexpr std::uint32_t version = 1;
+    static constexpr std::uint32_t noPage = 0;
+
+    struct Header {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t pageSize;
+        std::uint32_t keySize;
+        std::uint32_t degree;
+        std::uint32_t root;
+        std::uint32_t pageCount;
+        std::uint32_t reserved;
+        std::uint64_t count;
+    };
+
+    struct NodeHeader {
+        std::uint32_t n;
+        std::uint32_t leaf;
+    };
+
+    // Typed view of a pinned node page.
+    struct Node {
+        char* page;
+        std::size_t keyOffset;
+        std::size_t childOffset;
+
+        std::uint32_t& n() const { return reinterpret_cast<NodeHeader*>(page)->n; }
+        bool leaf() const { return reinterpret_cast<NodeHeader*>(page)->leaf != 0; }
+        T* keys() const { return reinterpret_cast<T*>(page + keyOffset); }
+        std::uint32_t* children() const { return reinterpret_cast<std::uint32_t*>(page + childOffset); }
+    };
+
+    Node pinNode(std::uint32_t id);
+    Node newNode(std::uint32_t& id, bool leaf);
+    bool splitChild(Node x, int i);
+    bool insertNonFull(std::uint32_t id, const T& k);
+    void traverse(std::uint32_t id);
+    bool writeHeader();
+
+    bool fail() {
+        open = false;
+        return false;
+    }
+
+    PageFile file;
+    std::unique_ptr<BufferPool> pool;
+    Header header;
+    std::size_t keyOffset;
+    std::size_t childOffset;
+    int t;
+    bool open;
+};
+
+template<typename T>
+inline DiskBTree<T>::DiskBTree(const std::string& path, std::size_t memoryBudget, std::uint32_t pageSize)
+    : file(path, pageSize), header(), t(0), open(false) {
+    if (!file.isOpen())
+        return;
+
+    if (file.isNew()) {
+        header = Header{ magic, version, pageSize, static_cast<std::uint32_t>(sizeof(T)), 0, noPage, 1, 0, 0 };
+    }
+    else {
+        std::vector<char> page(pageSize);
+        if (!file.read(0, page.data()))
+            return;
+        std::memcpy(&header, page.data(), sizeof(Header));
+        if (header.magic != magic || header.version != version || header.pageSize != pageSize
+            || header.keySize != sizeof(T))
+            return;
+    }
+
+    keyOffset = (sizeof(NodeHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+    if (header.degree == 0) {
+        // largest t whose 2t - 1 keys and 2t child ids fit in one page
+        int d = static_cast<int>(pageSize / (2 * (sizeof(T) + sizeof(std::uint32_t)))) + 1;
+        while (d > 2) {
+            std::size_t end = (keyOffset + (2 * d - 1) * sizeof(T) + 3) / 4 * 4 + 2 * d * sizeof(std::uint32_t);
+            if (end <= pageSize)
+                break;
+            d--;
+        }
+        header.degree = static_cast<std::uint32_t>(d);
+    }
+    t = static_cast<int>(header.degree);
+    childOffset = (keyOffset + (2 * t - 1) * sizeof(T) + 3) / 4 * 4;
+    if (childOffset + 2 * t * sizeof(std::uint32_t) > pageSize)
+        return;
+
+    std::size_t frames = memoryBudget / pageSize;
+    pool = std::make_unique<BufferPool>(file, frames < 16 ? 16 : frames);
+    open = file.isNew() ? writeHeader() && file.sync() : true;
+}
+
+// node.page is nullptr if the buffer pool could not supply the page.
+template<typename T>
+inline typename DiskBTree<T>::Node DiskBTree<T>::pinNode(std::uint32_t id) {
+    return Node{ pool->pin(id), keyOffset, childOffset };
+}
+
+template<typename T>
+inline typename DiskBTree<T>::Node DiskBTree<T>::newNode(std::uint32_t& id, bool leaf) {
+    id = header.pageCount++;
+    Node node{ pool->pinNew(id), keyOffset, childOffset };
+    reinterpret_cast<NodeHeader*>(node.page)->leaf = leaf ? 1 : 0;
+    return node;
+}
+
+template<typename T>
+inline bool DiskBTree<T>::search(const T& k) {
+    if (!open || header.root == noPage)
+        return false;
+
+    std::uint32_t id = header.root;
+    while (true) {
+        Node node = pinNode(id);
+        if (!node.page)
+            return fail();
+        int n = static_cast<int>(node.n());
+        int i = KeySearch<T>::lowerBound(node.keys(), n, k);
+        bool found = i < n && node.keys()[i] == k;
+        bool leaf = node.leaf();
+        std::uint32_t next = leaf ? noPage : node.children()[i];
+        pool->unpin(id, false);
+
+        if (found) return true;
+        if (leaf) return false;
+        id = next;
+    }
+}
+
+template<typename T>
+inline bool DiskBTree<T>::splitChild(Node x, int i) {
+    std::uint32_t yId = x.children()[i];
+    Node y = pinNode(yId);
+    if (!y.page)
+        return false;
+    std::uint32_t zId;
+    Node z = newNode(zId, y.leaf());
+    if (!z.page) {
+        pool->unpin(yId, false);
+        return false;
+    }
+    z.n() = t - 1;
+
+    for (int j = 0; j < t - 1; j++)
+        z.keys()[j] = y.keys()[j + t];
+
+    if (!y.leaf()) {
+        for (int j = 0; j < t; j++)
+            z.children()[j] = y.children()[j + t];
+    }
+
+    y.n() = t - 1;
+
+    int n = static_cast<int>(x.n());
+    for (int j = n; j >= i + 1; j--)
+        x.children()[j + 1] = x.children()[j];
+
+    x.children()[i + 1] = zId;
+
+    for (int j = n - 1; j >= i; j--)
+        x.keys()[j + 1] = x.keys()[j];
+
+    x.keys()[i] = y.keys()[t - 1];
+    x.n()++;
+
+    pool->unpin(zId, true);
+    pool->unpin(yId, true);
+    return true;
+}
+
+template<typename T>
+inline bool DiskBTree<T>::insertNonFull(std::uint32_t id, const T& k) {
+    while (true) {
+        Node node = pinNode(id);
+        if (!node.page)
+            return false;
+        int n = static_cast<int>(node.n());
+        int i = KeySearch<T>::upperBound(node.keys(), n, k);
+
+        if (node.leaf()) {
+            for (int j = n; j > i; j--)
+                node.keys()[j] = node.keys()[j - 1];
+            node.keys()[i] = k;
+            node.n()++;
+            pool->unpin(id, true);
+            return true;
+        }
+
+        bool dirty = false;
+        Node child = pinNode(node.children()[i]);
+        if (!child.page) {
+            pool->unpin(id, false);
+            return false;
+        }
+        bool full = child.n() == static_cast<std::uint32_t>(2 * t - 1);
+        pool->unpin(node.children()[i], false);
+        if (full) {
+            if (!splitChild(node, i)) {
+                pool->unpin(id, false);
+                return false;
+            }
+            if (k > node.keys()[i])
+                i++;
+            dirty = true;
+        }
+        std::uint32_t next = node.children()[i];
+        pool->unpin(id, dirty);
+        id = next;
+    }
+}
+
+template<typename T>
+inline bool DiskBTree<T>::insert(const T& k) {
+    if (!open)
+        return false;
+
+    if (header.root == noPage) {
+        std::uint32_t id;
+        Node root = newNode(id, true);
+        if (!root.page)
+            return fail();
+        root.keys()[0] = k;
+        root.n() = 1;
+        pool->unpin(id, true);
+        header.root = id;
+    }
+    else {
+        Node root = pinNode(header.root);
+        if (!root.page)
+            return fail();
+        bool full = root.n() == static_cast<std::uint32_t>(2 * t - 1);
+        pool->unpin(header.root, false);
+
+        if (full) {
+            std::uint32_t sId;
+            Node s = newNode(sId, false);
+            if (!s.page)
+                return fail();
+            s.children()[0] = header.root;
+            if (!splitChild(s, 0)) {
+                pool->unpin(sId, false);
+                return fail();
+            }
+            int i = (s.keys()[0] < k) ? 1 : 0;
+            std::uint32_t next = s.children()[i];
+            pool->unpin(sId, true);
+            header.root = sId;
+            if (!insertNonFull(next, k))
+                return fail();
+        }
+        else if (!insertNonFull(header.root, k)) {
+            return fail();
+        }
+    }
+    header.count++;
+    return true;
+}
+
+template<typename T>
+inline void DiskBTree<T>::traverse(std::uint32_t id) {
+    // copy the page so the recursion below does not keep it pinned
+    std::vector<char> copy(header.pageSize);
+    char* page = pool->pin(id);
+    if (!page) {
+        fail();
+        return;
+    }
+    std::memcpy(copy.data(), page, header.pageSize);
+    pool->unpin(id, false);
+    Node node{ copy.data(), keyOffset, childOffset };
+
+    int i;
+    int n = static_cast<int>(node.n());
+    for (i = 0; i < n; i++) {
+        if (!node.leaf())
+            traverse(node.children()[i]);
+        std::cout << " " << node.keys()[i];
+    }
+    if (!node.leaf())
+        traverse(node.children()[i]);
+}
+
+template<typename T>
+inline void DiskBTree<T>::traverse() {
+    if (open && header.root != noPage)
+        traverse(header.root);
+    else
+        std::cout << "Tree is empty\n";
+}
+
+template<typename T>
+inline bool DiskBTree<T>::writeHeader() {
+    std::vector<char> page(header.pageSize, 0);
+    std::memcpy(page.data(), &header, sizeof(Header));
+    return file.write(0, page.data());
+}
+
+// The pages are durable before the header that refers to them is written.
+template<typename T>
+inline bool DiskBTree<T>::flush() {
+    if (!open)
+        return false;
+    if (!pool->flush() || !file.sync() || !writeHeader() || !file.sync())
+        return fail();
+    return true;
+}
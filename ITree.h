@@ -3,6 +3,7 @@
 template<typename T>
 class ITree {
 public:
+    virtual ~ITree() = default;
     virtual void insert(const T& value) = 0;
     virtual void remove(const T& value) = 0;
     virtual bool search(const T& value) const = 0;
@@ -0,0 +1,236 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include "KeySearch.h"
+
+// Largest minimum degree whose internal node fits into `bytes`,
+// e.g. inlineBTreeDegree<T>(4 * 64) for four cache lines or
+// inlineBTreeDegree<T>(4096) for a page.
+template<typename T>
+constexpr int inlineBTreeDegree(std::size_t bytes) {
+    std::size_t header = alignof(T) > 8 ? alignof(T) : 8;
+    if (bytes < header + sizeof(T) + 2 * sizeof(void*))
+        return 2;
+    std::size_t t = (bytes - header + sizeof(T)) / (2 * (sizeof(T) + sizeof(void*)));
+    return t < 2 ? 2 : static_cast<int>(t);
+}
+
+// Count, leaf flag and keys live in one cache-line aligned block. Leaves are
+// allocated as this type only; internal nodes append the child array.
+template <typename T, int t>
+struct alignas(64) InlineBTreeNode {
+    int n;
+    bool leaf;
+    T keys[2 * t - 1];
+
+    explicit InlineBTreeNode(bool isLeaf) : n(0), leaf(isLeaf) {}
+};
+
+template <typename T, int t>
+struct InlineBTreeInner : InlineBTreeNode<T, t> {
+    InlineBTreeNode<T, t>* children[2 * t];
+
+    InlineBTreeInner() : InlineBTreeNode<T, t>(false) {}
+};
+
+template <typename T, int t = inlineBTreeDegree<T>(4 * 64)>
+class InlineBTree {
+    static_assert(t >= 2, "minimum degree must be at least 2");
+
+public:
+    using Node = InlineBTreeNode<T, t>;
+    static constexpr int minDegree = t;
+
+private:
+    using Inner = InlineBTreeInner<T, t>;
+
+    Node* root;
+
+    static Node** children(Node* node) { return static_cast<Inner*>(node)->children; }
+    static Node* createNode(bool leaf);
+    static void destroyNode(Node* node);
+
+    void traverse(Node* node);
+    Node* search(Node* node, const T& k);
+    void splitChild(Node* x, int i);
+    void insertNonFull(Node* node, const T& k);
+    void clear(Node* node);
+    void printRecursive(Node* node, int indent);
+
+public:
+    InlineBTree() : root(nullptr) {}
+    InlineBTree(const InlineBTree&) = delete;
+    InlineBTree& operator=(const InlineBTree&) = delete;
+
+    ~InlineBTree() {
+        clear(root);
+    }
+    void traverse();
+    Node* search(const T& k);
+    void insert(const T& k);
+    void print();
+};
+
+template<typename T, int t>
+inline typename InlineBTree<T, t>::Node* InlineBTree<T, t>::createNode(bool leaf) {
+    if (leaf)
+        return new Node(true);
+    return new Inner();
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::destroyNode(Node* node) {
+    if (node->leaf)
+        delete node;
+    else
+        delete static_cast<Inner*>(node);
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::traverse(Node* node) {
+    int i;
+    for (i = 0; i < node->n; i++) {
+        if (!node->leaf)
+            traverse(children(node)[i]);
+        std::cout << " " << node->keys[i];
+    }
+    if (!node->leaf)
+        traverse(children(node)[i]);
+}
+
+template<typename T, int t>
+inline typename InlineBTree<T, t>::Node* InlineBTree<T, t>::search(Node* node, const T& k) {
+    while (true) {
+        int i = KeySearch<T>::lowerBound(node->keys, node->n, k);
+
+        if (i < node->n && node->keys[i] == k)
+            return node;
+
+        if (node->leaf)
+            return nullptr;
+
+        node = children(node)[i];
+    }
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::splitChild(Node* x, int i) {
+    Node* y = children(x)[i];
+    Node* z = createNode(y->leaf);
+    z->n = t - 1;
+
+    for (int j = 0; j < t - 1; j++)
+        z->keys[j] = y->keys[j + t];
+
+    if (!y->leaf) {
+        for (int j = 0; j < t; j++)
+            children(z)[j] = children(y)[j + t];
+    }
+
+    y->n = t - 1;
+
+    for (int j = x->n; j >= i + 1; j--)
+        children(x)[j + 1] = children(x)[j];
+
+    children(x)[i + 1] = z;
+
+    for (int j = x->n - 1; j >= i; j--)
+        x->keys[j + 1] = x->keys[j];
+
+    x->keys[i] = y->keys[t - 1];
+    x->n++;
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::insertNonFull(Node* node, const T& k) {
+    while (true) {
+        int i = KeySearch<T>::upperBound(node->keys, node->n, k);
+
+        if (node->leaf) {
+            for (int j = node->n; j > i; j--)
+                node->keys[j] = node->keys[j - 1];
+
+            node->keys[i] = k;
+            node->n++;
+            return;
+        }
+
+        if (children(node)[i]->n == 2 * t - 1) {
+            splitChild(node, i);
+            if (k > node->keys[i])
+                i++;
+        }
+        node = children(node)[i];
+    }
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::clear(Node* node) {
+    if (!node) return;
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; i++)
+            clear(children(node)[i]);
+    }
+    destroyNode(node);
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::traverse() {
+    if (root != nullptr)
+        traverse(root);
+    else
+        std::cout << "Tree is empty\n";
+}
+
+template<typename T, int t>
+inline typename InlineBTree<T, t>::Node* InlineBTree<T, t>::search(const T& k) {
+    return (root == nullptr) ? nullptr : search(root, k);
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::insert(const T& k) {
+    if (root == nullptr) {
+        root = createNode(true);
+        root->keys[0] = k;
+        root->n = 1;
+    }
+    else {
+        if (root->n == 2 * t - 1) {
+            Node* s = createNode(false);
+            children(s)[0] = root;
+            splitChild(s, 0);
+            int i = (s->keys[0] < k) ? 1 : 0;
+            insertNonFull(children(s)[i], k);
+            root = s;
+        }
+        else {
+            insertNonFull(root, k);
+        }
+    }
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::print() {
+    printRecursive(root, 0);
+}
+
+template<typename T, int t>
+inline void InlineBTree<T, t>::printRecursive(Node* node, int indent) {
+    if (!node) return;
+
+    for (int i = 0; i < indent; ++i)
+        std::cout << "  ";
+
+    std::cout << "[";
+    for (int i = 0; i < node->n; ++i) {
+        std::cout << node->keys[i];
+        if (i != node->n - 1) std::cout << " ";
+    }
+    std::cout << "]\n";
+
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; ++i)
+            printRecursive(children(node)[i], indent + 1);
+    }
+}
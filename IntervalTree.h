@@ -0,0 +1,164 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "RedBlackTree.h"
+
+// Payload of an IntervalTree node: the interval's upper end and its value
+// (the lower end is the tree key).
+template<class K, class V>
+struct IntervalEntry {
+    K hi;
+    V value;
+};
+
+// Largest upper end in a subtree. K needs std::numeric_limits.
+template<class K, class V>
+struct IntervalAugment {
+    using value_type = K;
+
+    static value_type identity() { return std::numeric_limits<K>::lowest(); }
+    static value_type lift(const std::pair<const K, IntervalEntry<K, V>>& node) { return node.second.hi; }
+    static value_type combine(const value_type& a, const value_type& b) { return a < b ? b : a; }
+};
+
+// Closed intervals [lo, hi] with a value each, on a RedBlackTree ordered by
+// lo whose nodes also keep the largest hi of their subtree. A query for
+// [lo, hi] reads the intervals starting inside it as one in-order run, all
+// of which overlap, and finds those starting before lo by descending only
+// into subtrees whose largest hi reaches lo. That is O(log n + k) for k
+// results, plus at most O(log n) for each result that starts before lo.
+// Results come in ascending order of lo. Duplicate and nested intervals
+// are fine.
+template<class K, class V, class Allocator = std::allocator<std::pair<const K, IntervalEntry<K, V>>>>
+class IntervalTree
+    : private RedBlackTree<K, IntervalEntry<K, V>, ThreeWayCompare<K>, Allocator, NullStats, IntervalAugment<K, V>> {
+private:
+    using Base = RedBlackTree<K, IntervalEntry<K, V>, ThreeWayCompare<K>, Allocator, NullStats, IntervalAugment<K, V>>;
+    using rbNode = typename Base::rbNode;
+    using Base::root;
+    using Base::compare;
+
+    template<class F>
+    static bool report(const rbNode* node, F& f);
+    template<class F>
+    bool reportReaching(const rbNode* node, const K& lo, F& f) const;
+    template<class F>
+    void query(const K& lo, const K& hi, F& f) const;
+
+public:
+    IntervalTree() = default;
+    explicit IntervalTree(const Allocator& allocator) : Base(allocator) {}
+
+    // False, and nothing inserted, if hi < lo
+    bool insert(const K& lo, const K& hi, const V& value);
+    // Removes one interval [lo, hi]; false if there is none
+    bool remove(const K& lo, const K& hi);
+    void clear() { Base::clear(); }
+    std::size_t size() const { return static_cast<std::size_t>(Base::getSize()); }
+    bool empty() const { return root == nullptr; }
+
+    // Calls f(lo, hi, value) for every interval that shares a point with
+    // [lo, hi]. f may return bool; false stops the query.
+    template<class F>
+    void overlapping(const K& lo, const K& hi, F&& f) const { query(lo, hi, f); }
+    // Intervals that contain point
+    template<class F>
+    void stabbing(const K& point, F&& f) const { query(point, point, f); }
+    bool overlaps(const K& lo, const K& hi) const;
+
+    // Calls f(lo, hi, value) for every interval in ascending order of lo
+    template<class F>
+    void for_each(F&& f) const;
+};
+
+template<class K, class V, class Allocator>
+inline bool IntervalTree<K, V, Allocator>::insert(const K& lo, const K& hi, const V& value) {
+    if (compare(hi, lo) < 0)
+        return false;
+    Base::insert(lo, IntervalEntry<K, V>{ hi, value });
+    return true;
+}
+
+template<class K, class V, class Allocator>
+inline bool IntervalTree<K, V, Allocator>::remove(const K& lo, const K& hi) {
+    for (rbNode* node = Base::lowerNode(lo); node != nullptr && compare(node->data.first, lo) == 0; node = Base::next(node)) {
+        if (compare(node->data.second.hi, hi) == 0) {
+            Base::removeNode(node);
+            Base::size--;
+            return true;
+        }
+    }
+    return false;
+}
+
+// False once f asked to stop
+template<class K, class V, class Allocator>
+template<class F>
+inline bool IntervalTree<K, V, Allocator>::report(const rbNode* node, F& f) {
+    const auto& [lo, entry] = node->data;
+    if constexpr (std::is_convertible_v<std::invoke_result_t<F&, const K&, const K&, const V&>, bool>)
+        return f(lo, entry.hi, entry.value);
+    f(lo, entry.hi, entry.value);
+    return true;
+}
+
+// Reports, in order, the nodes of a subtree whose hi is not below lo
+template<class K, class V, class Allocator>
+template<class F>
+inline bool IntervalTree<K, V, Allocator>::reportReaching(const rbNode* node, const K& lo, F& f) const {
+    for (; node != nullptr && !(compare(node->agg, lo) < 0); node = node->right) {
+        if (!reportReaching(node->left, lo, f))
+            return false;
+        if (!(compare(node->data.second.hi, lo) < 0) && !report(node, f))
+            return false;
+    }
+    return true;
+}
+
+template<class K, class V, class Allocator>
+template<class F>
+inline void IntervalTree<K, V, Allocator>::query(const K& lo, const K& hi, F& f) const {
+    if (compare(hi, lo) < 0)
+        return;
+
+    // starting before lo: left of the search path for lo
+    const rbNode* node = root;
+    while (node != nullptr && !(compare(node->agg, lo) < 0)) {
+        if (compare(node->data.first, lo) < 0) {
+            if (!reportReaching(node->left, lo, f))
+                return;
+            if (!(compare(node->data.second.hi, lo) < 0) && !report(node, f))
+                return;
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+
+    // starting in [lo, hi]
+    for (rbNode* n = Base::lowerNode(lo); n != nullptr && !(compare(hi, n->data.first) < 0); n = Base::next(n)) {
+        if (!report(n, f))
+            return;
+    }
+}
+
+template<class K, class V, class Allocator>
+inline bool IntervalTree<K, V, Allocator>::overlaps(const K& lo, const K& hi) const {
+    bool found = false;
+    overlapping(lo, hi, [&](const K&, const K&, const V&) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+template<class K, class V, class Allocator>
+template<class F>
+inline void IntervalTree<K, V, Allocator>::for_each(F&& f) const {
+    for (const auto& [lo, entry] : static_cast<const Base&>(*this))
+        f(lo, entry.hi, entry.value);
+}
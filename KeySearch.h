@@ -0,0 +1,224 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TREELIB_KEYSEARCH_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TREELIB_KEYSEARCH_SSE2 1
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define TREELIB_KEYSEARCH_SSE42 1
+#endif
+#endif
+
+// Searches the sorted key array of a B-tree node.
+//   lowerBound: index of the first key that is not less than k
+//   upperBound: index of the first key that is greater than k
+// The generic version is a plain binary search that uses the same
+// operators as the original linear scans. Arithmetic keys get a
+// branchless binary search that narrows the range down to a small
+// window, which is then counted with SIMD compares (scalar fallback).
+template<typename T, typename Enable = void>
+struct KeySearch {
+    static int lowerBound(const T* keys, int n, const T& k) {
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (k > keys[mid]) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static int upperBound(const T* keys, int n, const T& k) {
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (k < keys[mid]) hi = mid;
+            else lo = mid + 1;
+        }
+        return lo;
+    }
+};
+
+template<typename T>
+struct KeySearch<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+    static constexpr int window = sizeof(T) >= 128 ? 1 : static_cast<int>(128 / sizeof(T));
+
+    static int lowerBound(const T* keys, int n, T k) {
+        const T* base = narrow<true>(keys, n, k);
+        return static_cast<int>(base - keys) + count<true>(base, n, k);
+    }
+
+    static int upperBound(const T* keys, int n, T k) {
+        const T* base = narrow<false>(keys, n, k);
+        return static_cast<int>(base - keys) + count<false>(base, n, k);
+    }
+
+private:
+    // Keeps the answer inside [base, base + n] without data-dependent branches.
+    template<bool Strict>
+    static const T* narrow(const T* base, int& n, T k) {
+        while (n > window) {
+            int half = n / 2;
+            bool right = Strict ? (base[half] < k) : !(k < base[half]);
+            base = right ? base + half : base;
+            n -= half;
+        }
+        return base;
+    }
+
+    // Number of keys in p[0, n) that are < k (Strict) or <= k.
+    template<bool Strict>
+    static int count(const T* p, int n, T k) {
+        int c = 0;
+        int i = 0;
+#if defined(TREELIB_KEYSEARCH_AVX2) || defined(TREELIB_KEYSEARCH_SSE2)
+        if constexpr (std::is_integral_v<T> && sizeof(T) == 4)
+            i = countInt32<Strict, std::is_signed_v<T>>(reinterpret_cast<const int32_t*>(p), n,
+                                                        static_cast<int32_t>(k), c);
+        else if constexpr (std::is_same_v<T, float>)
+            i = countFloat<Strict>(p, n, k, c);
+        else if constexpr (std::is_same_v<T, double>)
+            i = countDouble<Strict>(p, n, k, c);
+#if defined(TREELIB_KEYSEARCH_AVX2) || defined(TREELIB_KEYSEARCH_SSE42)
+        else if constexpr (std::is_integral_v<T> && sizeof(T) == 8)
+            i = countInt64<Strict, std::is_signed_v<T>>(reinterpret_cast<const int64_t*>(p), n,
+                                                        static_cast<int64_t>(k), c);
+#endif
+#endif
+        for (; i < n; i++)
+            c += Strict ? (p[i] < k) : !(k < p[i]);
+        return c;
+    }
+
+#if defined(TREELIB_KEYSEARCH_AVX2)
+    static int popcount(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        return static_cast<int>(__popcnt(mask));
+#else
+        return __builtin_popcount(mask);
+#endif
+    }
+
+    template<bool Strict, bool Signed>
+    static int countInt32(const int32_t* p, int n, int32_t k, int& c) {
+        const __m256i bias = _mm256_set1_epi32(Signed ? 0 : INT32_MIN);
+        const __m256i kv = _mm256_xor_si256(_mm256_set1_epi32(k), bias);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), bias);
+            __m256i gt = Strict ? _mm256_cmpgt_epi32(kv, x) : _mm256_cmpgt_epi32(x, kv);
+            int bits = popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(gt))));
+            c += Strict ? bits : 8 - bits;
+        }
+        return i;
+    }
+
+    template<bool Strict, bool Signed>
+    static int countInt64(const int64_t* p, int n, int64_t k, int& c) {
+        const __m256i bias = _mm256_set1_epi64x(Signed ? 0 : INT64_MIN);
+        const __m256i kv = _mm256_xor_si256(_mm256_set1_epi64x(k), bias);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), bias);
+            __m256i gt = Strict ? _mm256_cmpgt_epi64(kv, x) : _mm256_cmpgt_epi64(x, kv);
+            int bits = popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(gt))));
+            c += Strict ? bits : 4 - bits;
+        }
+        return i;
+    }
+
+    template<bool Strict>
+    static int countFloat(const float* p, int n, float k, int& c) {
+        const __m256 kv = _mm256_set1_ps(k);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps(p + i);
+            __m256 m = Strict ? _mm256_cmp_ps(x, kv, _CMP_LT_OQ) : _mm256_cmp_ps(x, kv, _CMP_LE_OQ);
+            c += popcount(static_cast<unsigned>(_mm256_movemask_ps(m)));
+        }
+        return i;
+    }
+
+    template<bool Strict>
+    static int countDouble(const double* p, int n, double k, int& c) {
+        const __m256d kv = _mm256_set1_pd(k);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(p + i);
+            __m256d m = Strict ? _mm256_cmp_pd(x, kv, _CMP_LT_OQ) : _mm256_cmp_pd(x, kv, _CMP_LE_OQ);
+            c += popcount(static_cast<unsigned>(_mm256_movemask_pd(m)));
+        }
+        return i;
+    }
+#elif defined(TREELIB_KEYSEARCH_SSE2)
+    static int popcount(unsigned mask) {
+        int c = 0;
+        for (; mask; mask &= mask - 1)
+            c++;
+        return c;
+    }
+
+    template<bool Strict, bool Signed>
+    static int countInt32(const int32_t* p, int n, int32_t k, int& c) {
+        const __m128i bias = _mm_set1_epi32(Signed ? 0 : INT32_MIN);
+        const __m128i kv = _mm_xor_si128(_mm_set1_epi32(k), bias);
+        __m128i acc = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), bias);
+            // compare lanes are all-ones (-1), so subtracting them counts
+            acc = _mm_sub_epi32(acc, Strict ? _mm_cmplt_epi32(x, kv) : _mm_cmpgt_epi32(x, kv));
+        }
+        int32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        int hits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        c += Strict ? hits : i - hits;
+        return i;
+    }
+
+#if defined(TREELIB_KEYSEARCH_SSE42)
+    template<bool Strict, bool Signed>
+    static int countInt64(const int64_t* p, int n, int64_t k, int& c) {
+        const __m128i bias = _mm_set1_epi64x(Signed ? 0 : INT64_MIN);
+        const __m128i kv = _mm_xor_si128(_mm_set1_epi64x(k), bias);
+        int i = 0;
+        for (; i + 2 <= n; i += 2) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), bias);
+            __m128i gt = Strict ? _mm_cmpgt_epi64(kv, x) : _mm_cmpgt_epi64(x, kv);
+            int bits = popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(gt))));
+            c += Strict ? bits : 2 - bits;
+        }
+        return i;
+    }
+#endif
+
+    template<bool Strict>
+    static int countFloat(const float* p, int n, float k, int& c) {
+        const __m128 kv = _mm_set1_ps(k);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(p + i);
+            __m128 m = Strict ? _mm_cmplt_ps(x, kv) : _mm_cmple_ps(x, kv);
+            c += popcount(static_cast<unsigned>(_mm_movemask_ps(m)));
+        }
+        return i;
+    }
+
+    template<bool Strict>
+    static int countDouble(const double* p, int n, double k, int& c) {
+        const __m128d kv = _mm_set1_pd(k);
+        int i = 0;
+        for (; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(p + i);
+            __m128d m = Strict ? _mm_cmplt_pd(x, kv) : _mm_cmple_pd(x, kv);
+            c += popcount(static_cast<unsigned>(_mm_movemask_pd(m)));
+        }
+        return i;
+    }
+#endif
+};
@@ -0,0 +1,549 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Epoch-based reclamation, shared by every persistent tree in the process.
+// A reader pins the global epoch in its thread's slot while it holds nodes;
+// a writer stamps the nodes it unlinks with the epoch and frees them once
+// every pinned slot is past it. Pinning touches only the caller's slot, so
+// readers never write to a line another reader writes to.
+class EpochDomain {
+public:
+    struct alignas(64) Slot {
+        // pins in the low bits, the epoch the first of them was taken in
+        // above them
+        std::atomic<std::uint64_t> state{ 0 };
+        std::atomic<bool> owned{ false };
+        Slot* next = nullptr;
+
+        // A slot that is already pinned keeps its epoch, so a pin taken on
+        // another thread's behalf (copying a snapshot) never moves it forward
+        void pin() {
+            std::uint64_t s = state.load(std::memory_order_relaxed);
+            std::uint64_t pinned;
+            do {
+                pinned = (s & pinMask) != 0 ? s + 1 : (epoch().load(std::memory_order_seq_cst) << pinBits) | 1;
+            } while (!state.compare_exchange_weak(s, pinned, std::memory_order_seq_cst, std::memory_order_relaxed));
+        }
+
+        void unpin() { state.fetch_sub(1, std::memory_order_release); }
+    };
+
+    // The calling thread's slot
+    static Slot& local() {
+        if (ownerGone())
+            return *slots().load(std::memory_order_acquire);
+        thread_local Owner owner;
+        return *owner.slot;
+    }
+
+    // Epoch for nodes unlinked before the call; the fence orders their
+    // unlinking before any reader that pins a later epoch
+    static std::uint64_t current() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return epoch().load(std::memory_order_relaxed);
+    }
+
+    // Moves the epoch on and returns the oldest one a reader may still be
+    // pinned in; nodes stamped before it are unreachable
+    static std::uint64_t oldest() {
+        std::uint64_t result = epoch().fetch_add(1, std::memory_order_seq_cst) + 1;
+        for (Slot* slot = slots().load(std::memory_order_acquire); slot != nullptr; slot = slot->next) {
+            std::uint64_t s = slot->state.load(std::memory_order_seq_cst);
+            if ((s & pinMask) != 0)
+                result = std::min(result, s >> pinBits);
+        }
+        return result;
+    }
+
+private:
+    static constexpr int pinBits = 24;
+    static constexpr std::uint64_t pinMask = (std::uint64_t(1) << pinBits) - 1;
+
+    // Claims a free slot for the thread, or adds one, and frees it again
+    // when the thread exits. Slots are never deallocated.
+    struct Owner {
+        Slot* slot;
+
+        Owner() : slot(nullptr) {
+            for (Slot* s = slots().load(std::memory_order_acquire); s != nullptr && slot == nullptr; s = s->next) {
+                bool expected = false;
+                if (s->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    slot = s;
+            }
+            if (slot == nullptr) {
+                slot = new Slot;
+                slot->owned.store(true, std::memory_order_relaxed);
+                slot->next = slots().load(std::memory_order_relaxed);
+                while (!slots().compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {}
+            }
+        }
+
+        ~Owner() {
+            slot->owned.store(false, std::memory_order_release);
+            ownerGone() = true;
+        }
+    };
+
+    static std::atomic<std::uint64_t>& epoch() {
+        static std::atomic<std::uint64_t> value{ 1 };
+        return value;
+    }
+
+    static std::atomic<Slot*>& slots() {
+        static std::atomic<Slot*> head{ nullptr };
+        return head;
+    }
+
+    // Set once the thread's Owner is destroyed; later pins on the thread
+    // (from other thread_local destructors) share the first slot, which is
+    // safe, as a pinned slot only ever keeps its older epoch.
+    static bool& ownerGone() {
+        thread_local bool gone = false;
+        return gone;
+    }
+};
+
+// AVL tree with persistent versions, for readers that need a consistent
+// view while writers keep updating. Published nodes are never modified:
+// insert and remove copy the O(log n) nodes on the path to the change,
+// plus the few that rebalancing rotates, share everything else with the
+// previous version, and publish the new root with one atomic store.
+//
+// snapshot() takes no lock and writes no shared counter: it pins the
+// calling thread's EpochDomain slot and loads the root. A snapshot keeps
+// its version readable for as long as it is held, and its copies share
+// its pin. Writers are serialized by a mutex. They count, on their side
+// only, how many live nodes and versions reference each node; a node that
+// drops out of the current version is retired with the epoch and freed by
+// a later write once no reader is pinned in that epoch or before it.
+// restore() may bring a retired node back; it is then simply not freed.
+// A held snapshot therefore delays freeing everything retired after it,
+// and no snapshot may outlive its tree.
+template<typename T, typename Allocator = std::allocator<T>>
+class PersistentAVLTree {
+private:
+    struct Node {
+        T data;
+        const Node* left;
+        const Node* right;
+        int height;
+        std::size_t size;
+        // writer bookkeeping, never read by snapshots: references from
+        // live nodes and the root; the write that made the node, or once
+        // retired the epoch it was retired in; the retired list
+        mutable std::uint32_t refs;
+        mutable bool retired;
+        mutable bool listed;
+        mutable std::uint64_t stamp;
+        mutable const Node* nextRetired;
+
+        Node(const T& val, const Node* l, const Node* r, std::uint64_t write)
+            : data(val), left(l), right(r),
+              height(1 + std::max(PersistentAVLTree::height(l), PersistentAVLTree::height(r))),
+              size(1 + PersistentAVLTree::size(l) + PersistentAVLTree::size(r)),
+              refs(0), retired(false), listed(false), stamp(write), nextRetired(nullptr) {}
+    };
+
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    // nodes retired between two attempts to free them
+    static constexpr std::size_t retireBatch = 64;
+
+    static int height(const Node* node) { return node ? node->height : 0; }
+    static std::size_t size(const Node* node) { return node ? node->size : 0; }
+
+    std::atomic<const Node*> root;
+    std::mutex writer;
+    std::uint64_t write;
+    // oldest first, so reclaim() stops at the first node still pinned
+    const Node* retiredHead;
+    const Node* retiredTail;
+    // nodes retired since the last reclaim()
+    std::size_t retiredCount;
+    [[no_unique_address]] NodeAllocator alloc;
+
+    const Node* makeNode(const T& data, const Node* left, const Node* right);
+    void destroyNode(const Node* node);
+    void acquire(const Node* node);
+    void release(const Node* node, std::uint64_t epoch);
+    void discard(const Node* node);
+    void publish(const Node* next);
+    void reclaim();
+
+    const Node* balance(const T& data, const Node* left, const Node* right);
+    const Node* insert(const Node* node, const T& key);
+    const Node* remove(const Node* node, const T& key);
+    const Node* removeMin(const Node* node, const T*& min);
+
+    static std::size_t countBelow(const Node* node, const T& value, bool inclusive);
+    template<typename F>
+    static void visit(const Node* node, F& f);
+
+public:
+    // An immutable version of the tree. Copying one is O(1); it stays
+    // valid, and unchanged, however the tree is modified afterwards.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+        Snapshot(const Snapshot& other) : slot(other.slot), root(other.root) {
+            if (slot)
+                slot->pin();
+        }
+        Snapshot(Snapshot&& other) noexcept : slot(std::exchange(other.slot, nullptr)), root(std::exchange(other.root, nullptr)) {}
+        Snapshot& operator=(Snapshot other) noexcept {
+            std::swap(slot, other.slot);
+            std::swap(root, other.root);
+            return *this;
+        }
+        ~Snapshot() {
+            if (slot)
+                slot->unpin();
+        }
+
+        std::size_t size() const { return PersistentAVLTree::size(root); }
+        bool empty() const { return !root; }
+        bool search(const T& value) const;
+        // number of keys less than value
+        std::size_t rank(const T& value) const { return countBelow(root, value, false); }
+        // k-th smallest key (from zero) or nullptr; valid while the snapshot is
+        const T* select(std::size_t k) const;
+        // number of keys in [lo, hi]
+        std::size_t count_range(const T& lo, const T& hi) const;
+        // Calls f on every key in ascending order
+        template<typename F>
+        void for_each(F&& f) const { visit(root, f); }
+
+    private:
+        friend class PersistentAVLTree;
+        Snapshot(EpochDomain::Slot* slot, const Node* root) : slot(slot), root(root) {}
+
+        EpochDomain::Slot* slot = nullptr;
+        const Node* root = nullptr;
+    };
+
+    PersistentAVLTree() : PersistentAVLTree(Allocator()) {}
+    explicit PersistentAVLTree(const Allocator& allocator)
+        : root(nullptr), write(0), retiredHead(nullptr), retiredTail(nullptr), retiredCount(0), alloc(allocator) {}
+    PersistentAVLTree(const PersistentAVLTree&) = delete;
+    PersistentAVLTree& operator=(const PersistentAVLTree&) = delete;
+    ~PersistentAVLTree();
+
+    void insert(const T& value);
+    void remove(const T& value);
+    void clear();
+    // Makes snapshot the current version, e.g. to roll back
+    void restore(const Snapshot& snapshot);
+
+    // The current version, in O(1) and without taking the writer mutex.
+    // The root is loaded seq_cst rather than acquire so that the load is
+    // ordered after the pin; it is the same plain load on x86.
+    Snapshot snapshot() const {
+        EpochDomain::Slot& slot = EpochDomain::local();
+        slot.pin();
+        return Snapshot(&slot, root.load(std::memory_order_seq_cst));
+    }
+    bool search(const T& value) const { return snapshot().search(value); }
+    std::size_t size() const { return snapshot().size(); }
+};
+
+// Frees every node, retired or not; no snapshot may be held any more
+template<typename T, typename Allocator>
+inline PersistentAVLTree<T, Allocator>::~PersistentAVLTree() {
+    release(root.load(std::memory_order_relaxed), 0);
+    while (retiredHead) {
+        const Node* node = retiredHead;
+        retiredHead = node->nextRetired;
+        destroyNode(node);
+    }
+}
+
+template<typename T, typename Allocator>
+inline const typename PersistentAVLTree<T, Allocator>::Node* PersistentAVLTree<T, Allocator>::makeNode(const T& data, const Node* left, const Node* right) {
+    Node* node = NodeTraits::allocate(alloc, 1);
+    NodeTraits::construct(alloc, node, data, left, right, write);
+    acquire(left);
+    acquire(right);
+    return node;
+}
+
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::destroyNode(const Node* node) {
+    Node* p = const_cast<Node*>(node);
+    NodeTraits::destroy(alloc, p);
+    NodeTraits::deallocate(alloc, p, 1);
+}
+
+// A retired node referenced again (restore()) references its children
+// again too; it stays on the retired list until reclaim() drops it there.
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::acquire(const Node* node) {
+    if (!node || node->refs++ > 0 || !node->retired)
+        return;
+    node->retired = false;
+    node->stamp = 0;
+    acquire(node->left);
+    acquire(node->right);
+}
+
+// Drops a reference. A node nothing references any more is freed at once
+// if this write made it, since no reader can have seen it, and retired
+// with epoch otherwise.
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::release(const Node* node, std::uint64_t epoch) {
+    if (!node || --node->refs > 0)
+        return;
+    release(node->left, epoch);
+    release(node->right, epoch);
+    if (node->stamp == write) {
+        destroyNode(node);
+        return;
+    }
+    node->retired = true;
+    node->stamp = epoch;
+    retiredCount++;
+    if (node->listed)
+        return;
+    node->listed = true;
+    node->nextRetired = nullptr;
+    if (retiredTail)
+        retiredTail->nextRetired = node;
+    else
+        retiredHead = node;
+    retiredTail = node;
+}
+
+// Frees a node balance() rotated away if it was made by this write and so
+// is referenced by nothing
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::discard(const Node* node) {
+    if (node->refs > 0)
+        return;
+    node->refs = 1;
+    release(node, 0);
+}
+
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::publish(const Node* next) {
+    const Node* current = root.load(std::memory_order_relaxed);
+    if (next == current)
+        return;
+    acquire(next);
+    root.store(next, std::memory_order_release);
+    release(current, EpochDomain::current());
+    if (retiredCount >= retireBatch)
+        reclaim();
+}
+
+// Frees retired nodes, oldest first, up to the first one a pinned reader
+// may still reach, and unlists those restore() brought back. A node
+// retired again while still listed keeps its place, so it can only hold
+// back the ones behind it for longer.
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::reclaim() {
+    std::uint64_t oldest = EpochDomain::oldest();
+    while (retiredHead && !(retiredHead->retired && retiredHead->stamp >= oldest)) {
+        const Node* node = retiredHead;
+        retiredHead = node->nextRetired;
+        if (node->retired)
+            destroyNode(node);
+        else
+            node->listed = false;
+    }
+    if (!retiredHead)
+        retiredTail = nullptr;
+    retiredCount = 0;
+}
+
+// New node over left and right, rotated if their heights differ by 2. The
+// rotated nodes are copies; the subtrees below them are shared.
+template<typename T, typename Allocator>
+inline const typename PersistentAVLTree<T, Allocator>::Node* PersistentAVLTree<T, Allocator>::balance(const T& data, const Node* left, const Node* right) {
+    int hl = height(left);
+    int hr = height(right);
+
+    const Node* result;
+    if (hl > hr + 1) {
+        const Node* ll = left->left;
+        const Node* lr = left->right;
+        if (height(ll) >= height(lr))
+            result = makeNode(left->data, ll, makeNode(data, lr, right));
+        else
+            result = makeNode(lr->data, makeNode(left->data, ll, lr->left), makeNode(data, lr->right, right));
+        discard(left);
+        return result;
+    }
+    if (hr > hl + 1) {
+        const Node* rl = right->left;
+        const Node* rr = right->right;
+        if (height(rr) >= height(rl))
+            result = makeNode(right->data, makeNode(data, left, rl), rr);
+        else
+            result = makeNode(rl->data, makeNode(data, left, rl->left), makeNode(right->data, rl->right, rr));
+        discard(right);
+        return result;
+    }
+    return makeNode(data, left, right);
+}
+
+// Returns node itself when the key is already present, so an insert that
+// changes nothing copies nothing.
+template<typename T, typename Allocator>
+inline const typename PersistentAVLTree<T, Allocator>::Node* PersistentAVLTree<T, Allocator>::insert(const Node* node, const T& key) {
+    if (!node)
+        return makeNode(key, nullptr, nullptr);
+
+    if (key < node->data) {
+        const Node* left = insert(node->left, key);
+        if (left == node->left)
+            return node;
+        return balance(node->data, left, node->right);
+    }
+    if (node->data < key) {
+        const Node* right = insert(node->right, key);
+        if (right == node->right)
+            return node;
+        return balance(node->data, node->left, right);
+    }
+    return node;
+}
+
+template<typename T, typename Allocator>
+inline const typename PersistentAVLTree<T, Allocator>::Node* PersistentAVLTree<T, Allocator>::removeMin(const Node* node, const T*& min) {
+    if (!node->left) {
+        min = &node->data;
+        return node->right;
+    }
+    return balance(node->data, removeMin(node->left, min), node->right);
+}
+
+// Returns node itself when the key is absent
+template<typename T, typename Allocator>
+inline const typename PersistentAVLTree<T, Allocator>::Node* PersistentAVLTree<T, Allocator>::remove(const Node* node, const T& key) {
+    if (!node)
+        return nullptr;
+
+    if (key < node->data) {
+        const Node* left = remove(node->left, key);
+        if (left == node->left)
+            return node;
+        return balance(node->data, left, node->right);
+    }
+    if (node->data < key) {
+        const Node* right = remove(node->right, key);
+        if (right == node->right)
+            return node;
+        return balance(node->data, node->left, right);
+    }
+
+    if (!node->left)
+        return node->right;
+    if (!node->right)
+        return node->left;
+    // min points into the current version, which is not freed before the
+    // new one is published
+    const T* min = nullptr;
+    const Node* right = removeMin(node->right, min);
+    return balance(*min, node->left, right);
+}
+
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::insert(const T& value) {
+    std::lock_guard<std::mutex> lock(writer);
+    write++;
+    publish(insert(root.load(std::memory_order_relaxed), value));
+}
+
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::remove(const T& value) {
+    std::lock_guard<std::mutex> lock(writer);
+    write++;
+    publish(remove(root.load(std::memory_order_relaxed), value));
+}
+
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::clear() {
+    std::lock_guard<std::mutex> lock(writer);
+    write++;
+    publish(nullptr);
+}
+
+// The snapshot's pin keeps its nodes allocated, retired or not
+template<typename T, typename Allocator>
+inline void PersistentAVLTree<T, Allocator>::restore(const Snapshot& snapshot) {
+    std::lock_guard<std::mutex> lock(writer);
+    write++;
+    publish(snapshot.root);
+}
+
+template<typename T, typename Allocator>
+inline std::size_t PersistentAVLTree<T, Allocator>::countBelow(const Node* node, const T& value, bool inclusive) {
+    std::size_t count = 0;
+    while (node) {
+        bool goRight = inclusive ? !(value < node->data) : node->data < value;
+        if (goRight) {
+            count += size(node->left) + 1;
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+    return count;
+}
+
+template<typename T, typename Allocator>
+template<typename F>
+inline void PersistentAVLTree<T, Allocator>::visit(const Node* node, F& f) {
+    if (!node)
+        return;
+    visit(node->left, f);
+    f(node->data);
+    visit(node->right, f);
+}
+
+template<typename T, typename Allocator>
+inline bool PersistentAVLTree<T, Allocator>::Snapshot::search(const T& value) const {
+    const Node* current = root;
+    while (current) {
+        if (value < current->data)
+            current = current->left;
+        else if (current->data < value)
+            current = current->right;
+        else
+            return true;
+    }
+    return false;
+}
+
+template<typename T, typename Allocator>
+inline const T* PersistentAVLTree<T, Allocator>::Snapshot::select(std::size_t k) const {
+    const Node* current = root;
+    while (current) {
+        std::size_t leftSize = PersistentAVLTree::size(current->left);
+        if (k < leftSize) {
+            current = current->left;
+        }
+        else if (k == leftSize) {
+            return &current->data;
+        }
+        else {
+            k -= leftSize + 1;
+            current = current->right;
+        }
+    }
+    return nullptr;
+}
+
+template<typename T, typename Allocator>
+inline std::size_t PersistentAVLTree<T, Allocator>::Snapshot::count_range(const T& lo, const T& hi) const {
+    if (hi < lo)
+        return 0;
+    return countBelow(root, hi, true) - countBelow(root, lo, false);
+}
@@ -1,144 +1,526 @@
 #pragma once
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include "Allocator.h"
+#include "Augment.h"
+#include "Snapshot.h"
+#include "StaticSearchTree.h"
+#include "TreeStats.h"
+
+// Default comparator: one call returns <0, 0 or >0. Types with <=> use it,
+// anything else falls back to operator<. Lookup arguments are converted
+// to K first, as with std::less<K>.
+template<class K>
+struct ThreeWayCompare {
+	int operator()(const K& a, const K& b) const {
+		if constexpr (std::three_way_comparable<K>) {
+			auto c = a <=> b;
+			return c < 0 ? -1 : (c > 0 ? 1 : 0);
+		}
+		else {
+			return a < b ? -1 : (b < a ? 1 : 0);
+		}
+	}
+};
+
+// Strings compare by content and are transparent: C strings, string_view
+// and std::string lookups work on each other's trees without a copy.
+template<>
+struct ThreeWayCompare<const char*> {
+	using is_transparent = void;
+
+	int operator()(const char* a, const char* b) const { return std::strcmp(a, b); }
+	int operator()(std::string_view a, std::string_view b) const { return a.compare(b); }
+};
+
+template<>
+struct ThreeWayCompare<char*> : ThreeWayCompare<const char*> {};
+
+template<>
+struct ThreeWayCompare<std::string_view> : ThreeWayCompare<const char*> {};
 
-template<class K, class T>
+template<>
+struct ThreeWayCompare<std::string> : ThreeWayCompare<const char*> {};
+
+// Lookups take anything a transparent comparator accepts; otherwise the
+// argument has to convert to K, and is searched for as that K.
+template<class Compare, class Key, class K>
+concept LookupKey = std::is_same_v<Key, K> || std::is_convertible_v<const Key&, K> || requires { typename Compare::is_transparent; };
+
+template<class Compare, class Key, class K>
+using LookupArg = std::conditional_t<requires { typename Compare::is_transparent; }, Key, K>;
+
+// Augment (see Augment.h) is lifted from each (key, value) pair and kept
+// per subtree through inserts, removals and rotations; with one, values
+// must not be changed through iterators.
+template<class K, class T, class Compare = ThreeWayCompare<K>, class Allocator = std::allocator<std::pair<const K, T>>, class Stats = NullStats,
+	class Augment = NoAugment<std::pair<const K, T>>>
 class RedBlackTree {
-private:
-	enum color {
+public:
+	using aggregate_type = typename Augment::value_type;
+
+protected:
+	enum Color {
 		BLACK,
 		RED
 	};
 	
 	struct rbNode {
-		K     key;
-		T     val;
-		color	color;
+		std::pair<const K, T> data;
+		Color	color;
 		rbNode* parent;
 		rbNode* left;
 		rbNode* right;
+		[[no_unique_address]] aggregate_type agg;
 
-		rbNode() :parent(nullptr), left(nullptr), right(nullptr), color(RED) {}
+		rbNode(const K& k, const T& v, aggregate_type a) :data(k, v), color(RED), parent(nullptr), left(nullptr), right(nullptr), agg(a) {}
 	};
 
+	using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<rbNode>;
+	using NodeTraits = std::allocator_traits<NodeAllocator>;
+
 	int   size;
 	rbNode* root;
-
-	int cmp(const K a, const K b) const;
+	NodeAllocator alloc;
+	[[no_unique_address]] Compare compare;
+	[[no_unique_address]] mutable Stats stats;
+	[[no_unique_address]] Augment augment;
+
+	// NoAugment keeps nothing, and nothing is maintained for it
+	static constexpr bool augmented = !std::is_empty_v<aggregate_type>;
+
+	rbNode* createNode(const K& key, const T& val);
+	void destroyNode(rbNode* node);
+	void clear(rbNode* node);
+
+	static bool isRed(rbNode* node) { return node != nullptr && node->color == RED; }
+	aggregate_type aggregate(rbNode* node) const { return node != nullptr ? node->agg : augment.identity(); }
+	void update(rbNode* node);
+	void updatePath(rbNode* node);
+	static rbNode* minNode(rbNode* node);
+	static rbNode* maxNode(rbNode* node);
+	static rbNode* next(rbNode* node);
+	static rbNode* prev(rbNode* node);
+
+	template<class Key>
+	rbNode* findNode(const Key& key) const;
+	template<class Key>
+	rbNode* findNode(rbNode* from, const Key& key, rbNode*& last) const;
+	template<class Key>
+	rbNode* climb(rbNode* finger, const Key& key, bool insertion) const;
+	template<class InputIt, class Emit>
+	void findBatch(InputIt first, InputIt last, Emit emit) const;
+	template<class Key>
+	rbNode* lowerNode(const Key& key) const;
+	template<class Key>
+	rbNode* upperNode(const Key& key) const;
 	void leftRotate(rbNode* node);
 	void rightRotate(rbNode* node);
+	void attach(rbNode* node, rbNode* from);
+	void insertFixup(rbNode* node);
+	void transplant(rbNode* u, rbNode* v);
 	void removeNode(rbNode* node);
+	void removeFixup(rbNode* node, rbNode* parent);
 	void printHelper(rbNode* node, std::string indent, bool last);
+	int verify(rbNode* node, rbNode* parent, int& count) const;
+	rbNode* build(SnapshotReader& in, std::size_t n, int depth, int redDepth, rbNode* parent, bool& ok);
+	bool restore(SnapshotReader& in);
+
+	// In-order iterator over the parent links; end() is a null node and
+	// steps back to the maximum. Only erasing the element itself
+	// invalidates it.
+	template<bool Const>
+	class Iterator {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = std::pair<const K, T>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+		using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+		Iterator() : node(nullptr), tree(nullptr) {}
+		template<bool C = Const, class = std::enable_if_t<C>>
+		Iterator(const Iterator<false>& other) : node(other.node), tree(other.tree) {}
+
+		reference operator*() const { return node->data; }
+		pointer operator->() const { return &node->data; }
+
+		Iterator& operator++() {
+			node = next(node);
+			return *this;
+		}
+
+		Iterator& operator--() {
+			node = node == nullptr ? maxNode(tree->root) : prev(node);
+			return *this;
+		}
+
+		Iterator operator++(int) { Iterator old = *this; ++*this; return old; }
+		Iterator operator--(int) { Iterator old = *this; --*this; return old; }
+
+		bool operator==(const Iterator& other) const { return node == other.node; }
+		bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+	private:
+		friend class RedBlackTree;
+		template<bool>
+		friend class Iterator;
+		Iterator(rbNode* n, const RedBlackTree* owner) : node(n), tree(owner) {}
+
+		rbNode* node;
+		const RedBlackTree* tree;
+	};
 
 public:
-	RedBlackTree() : root(nullptr) {};
-	void insert(K key, T val);
-	bool remove(const K key);
-	bool search(const K key, T val) const;
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+	RedBlackTree() : size(0), root(nullptr) {};
+	explicit RedBlackTree(const Compare& comp, const Allocator& allocator = Allocator()) : size(0), root(nullptr), alloc(allocator), compare(comp) {}
+	explicit RedBlackTree(const Allocator& allocator) : size(0), root(nullptr), alloc(allocator) {}
+	RedBlackTree(const RedBlackTree&) = delete;
+	RedBlackTree& operator=(const RedBlackTree&) = delete;
+	~RedBlackTree() { clear(); }
+	void insert(const K& key, const T& val);
+	// Inserts the (key, value) pairs of [first, last). Each descent starts
+	// from the previous key's node, climbing parent links only as far as
+	// needed, so a sorted batch costs amortized O(1) search steps per key.
+	// Without level links the climb can still reach the root when adjacent
+	// keys straddle a high ancestor, so the worst case stays O(log n) per
+	// key. Every key is rebalanced as it is attached; nothing is deferred.
+	template<class InputIt>
+	void insert_batch(InputIt first, InputIt last);
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	bool remove(const Key& key);
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	bool search(const Key& key, T& val) const;
 	void clear();
 	int getSize() const;
 	void print();
+
+	// Snapshots (see Snapshot.h). load rebuilds a perfectly balanced tree
+	// in O(n) with no comparisons or rotations, and on failure returns
+	// false with the tree unchanged. load(path) maps the file.
+	bool save(std::ostream& out) const;
+	bool save(const std::string& path) const;
+	bool load(std::istream& in);
+	bool load(const std::string& path);
+
+	// Immutable copy for lookups once the tree stops changing
+	StaticSearchTree<K, T> freeze() const;
+
+	const Stats& getStats() const { return stats; }
+	// Bytes held by the nodes, and how much of that is padding
+	MemoryFootprint memory_footprint() const;
+	// Checks the red-black invariants: a black root, no red node with a red
+	// child, the same number of black nodes on every path, parent links that
+	// match, keys in order and the element count. For tests and debugging.
+	bool verify() const;
+
+	iterator begin() { return iterator(minNode(root), this); }
+	iterator end() { return iterator(nullptr, this); }
+	const_iterator begin() const { return const_iterator(minNode(root), this); }
+	const_iterator end() const { return const_iterator(nullptr, this); }
+	reverse_iterator rbegin() { return reverse_iterator(end()); }
+	reverse_iterator rend() { return reverse_iterator(begin()); }
+	const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+	const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+	// Iterator to an element with the given key, or end()
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	iterator find(const Key& key) { return iterator(findNode(key), this); }
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	const_iterator find(const Key& key) const { return const_iterator(findNode(key), this); }
+
+	// First element not less than / greater than key
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	iterator lower_bound(const Key& key) { return iterator(lowerNode(key), this); }
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	const_iterator lower_bound(const Key& key) const { return const_iterator(lowerNode(key), this); }
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	iterator upper_bound(const Key& key) { return iterator(upperNode(key), this); }
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	const_iterator upper_bound(const Key& key) const { return const_iterator(upperNode(key), this); }
+
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	std::pair<iterator, iterator> equal_range(const Key& key) { return { lower_bound(key), upper_bound(key) }; }
+	template<class Key = K> requires LookupKey<Compare, Key, K>
+	std::pair<const_iterator, const_iterator> equal_range(const Key& key) const { return { lower_bound(key), upper_bound(key) }; }
+
+	// find() for every key of [first, last), written to out in order. Like
+	// insert_batch, each search starts from where the previous one ended.
+	template<class InputIt, class OutputIt>
+	OutputIt find_batch(InputIt first, InputIt last, OutputIt out) {
+		findBatch(first, last, [&](rbNode* node) { *out++ = iterator(node, this); });
+		return out;
+	}
+	template<class InputIt, class OutputIt>
+	OutputIt find_batch(InputIt first, InputIt last, OutputIt out) const {
+		findBatch(first, last, [&](rbNode* node) { *out++ = const_iterator(node, this); });
+		return out;
+	}
 };
 
-template<class K, class T>
-void RedBlackTree<K, T>::insert(K key, T val) {
-	rbNode* node = new rbNode;
-	node->key = key;
-	node->val = val;
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::insert(const K& key, const T& val) {
+	rbNode* node = createNode(key, val);
+	attach(node, root);
+	this->size++;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class InputIt>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::insert_batch(InputIt first, InputIt last) {
+	rbNode* finger = nullptr;
+	for (; first != last; ++first) {
+		const auto& [key, val] = *first;
+		rbNode* node = createNode(key, val);
+		attach(node, finger != nullptr ? climb(finger, node->data.first, true) : root);
+		this->size++;
+		finger = node;
+	}
+}
 
+// Links node in as a leaf below from, whose subtree must be where the
+// key belongs, and rebalances. Equal keys go to the right.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::attach(rbNode* node, rbNode* from) {
 	if (root == nullptr) {
 		root = node;
 		node->color = BLACK;
 		return;
 	}
 
-	rbNode* curr = root;
-	while (curr->left != nullptr || curr->right != nullptr)
+	const K& key = node->data.first;
+	rbNode* curr = from;
+	bool less;
+	while (true)
 	{
-		if (cmp(key, curr->key) == -1)
-		{
-			if (curr->left)
-				curr = curr->left;
-			else
-				break;
-		}
-		else
-		{
-			if (curr->right)
-				curr = curr->right;
-			else
-				break;
-		}
+		stats.comparison();
+		less = compare(key, curr->data.first) < 0;
+		rbNode* next = less ? curr->left : curr->right;
+		if (next == nullptr)
+			break;
+		curr = next;
 	}
 	node->parent = curr;
-	if (cmp(key, curr->key) == -1)
+	if (less)
 		curr->left = node;
 	else
 		curr->right = node;
 
-	while (curr->color == RED && curr->parent != nullptr)
+	updatePath(curr);
+	insertFixup(node);
+}
+
+// Finger search: climbs from finger to the lowest ancestor whose subtree
+// spans key. Going up, a node stops the climb once it is the left child
+// of a parent above key; going down, once it is the right child of a
+// parent below key, or equal to it when inserting, since equal keys go
+// right. The other bound already holds because finger lies inside, so a
+// descent from there ends where one from the root would.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::climb(rbNode* finger, const Key& key, bool insertion) const {
+	bool up = compare(key, finger->data.first) >= 0;
+	rbNode* node = finger;
+	while (node->parent != nullptr)
 	{
-		bool isRight = (curr == curr->parent->right);
-		rbNode* uncle;
-		if (isRight)
-			uncle = curr->parent->left;
-		else
-			uncle = curr->parent->right;
-
-		if (uncle == nullptr) {
-			curr->color = BLACK;
-			curr->parent->color = RED;
-			if (uncle == curr->parent->right) {
-				rightRotate(curr->parent);
+		rbNode* parent = node->parent;
+		stats.comparison();
+		int c = compare(key, parent->data.first);
+		if (up ? (node == parent->left && c < 0) : (node == parent->right && (c > 0 || (insertion && c == 0))))
+			break;
+		node = parent;
+	}
+	return node;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class InputIt, class Emit>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::findBatch(InputIt first, InputIt last, Emit emit) const {
+	rbNode* finger = nullptr;
+	for (; first != last; ++first) {
+		const LookupArg<Compare, std::decay_t<decltype(*first)>, K>& key = *first;
+		rbNode* from = finger != nullptr ? climb(finger, key, false) : root;
+		emit(findNode(from, key, finger));
+	}
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::insertFixup(rbNode* node) {
+	while (isRed(node->parent))
+	{
+		rbNode* parent = node->parent;
+		rbNode* grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			rbNode* uncle = grandparent->right;
+			if (isRed(uncle)) {
+				parent->color = BLACK;
+				uncle->color = BLACK;
+				grandparent->color = RED;
+				node = grandparent;
+				continue;
 			}
-			else {
-				leftRotate(curr->parent);
+			if (node == parent->right) {
+				leftRotate(parent);
+				node = parent;
+				parent = node->parent;
 			}
-			break;
-		}
-		else if (uncle->color == RED) {
-			curr->color = BLACK;
-			uncle->color = BLACK;
-			curr->parent->color = RED;
-			curr = curr->parent;
+			parent->color = BLACK;
+			grandparent->color = RED;
+			rightRotate(grandparent);
 		}
 		else {
-			curr->color = BLACK;
-			curr->parent->color = RED;
-
-			if (isRight) {
-				if (node == curr->left) {
-					rightRotate(curr);
-					curr = node;
-				}
-				leftRotate(curr->parent);
+			rbNode* uncle = grandparent->left;
+			if (isRed(uncle)) {
+				parent->color = BLACK;
+				uncle->color = BLACK;
+				grandparent->color = RED;
+				node = grandparent;
+				continue;
 			}
-			else {
-				if (node == curr->right) {
-					leftRotate(curr);
-					curr = node;
-				}
-				rightRotate(curr->parent);
+			if (node == parent->left) {
+				rightRotate(parent);
+				node = parent;
+				parent = node->parent;
 			}
+			parent->color = BLACK;
+			grandparent->color = RED;
+			leftRotate(grandparent);
 		}
-		root->color = BLACK;
 	}
+	root->color = BLACK;
+}
 
-	this->size++;
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::findNode(const Key& key) const {
+	rbNode* last;
+	return findNode(root, static_cast<const LookupArg<Compare, Key, K>&>(key), last);
 }
 
-template<class K, class T>
-bool RedBlackTree<K, T>::remove(const K key) {
-	auto curr = root;
-	while (curr->left != nullptr | curr->right != nullptr)
+// Searches the subtree of from; last is the final node visited.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::findNode(rbNode* from, const Key& key, rbNode*& last) const {
+	rbNode* curr = from;
+	int depth = 0;
+	last = from;
+	while (curr != nullptr)
 	{
-		if (curr->key == key)
+		depth++;
+		last = curr;
+		stats.comparison();
+		int c = compare(key, curr->data.first);
+		if (c == 0)
 			break;
+		curr = c < 0 ? curr->left : curr->right;
+	}
+	stats.depth(depth);
+	return curr;
+}
 
-		if (cmp(key, curr->key) >= 0)
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::lowerNode(const Key& arg) const {
+	const LookupArg<Compare, Key, K>& key = arg;
+	rbNode* result = nullptr;
+	rbNode* curr = root;
+	int depth = 0;
+	while (curr != nullptr)
+	{
+		depth++;
+		stats.comparison();
+		if (compare(key, curr->data.first) > 0) {
 			curr = curr->right;
-		else
+		}
+		else {
+			result = curr;
 			curr = curr->left;
+		}
 	}
-	if (curr->key != key)
+	stats.depth(depth);
+	return result;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::upperNode(const Key& arg) const {
+	const LookupArg<Compare, Key, K>& key = arg;
+	rbNode* result = nullptr;
+	rbNode* curr = root;
+	int depth = 0;
+	while (curr != nullptr)
+	{
+		depth++;
+		stats.comparison();
+		if (compare(key, curr->data.first) < 0) {
+			result = curr;
+			curr = curr->left;
+		}
+		else {
+			curr = curr->right;
+		}
+	}
+	stats.depth(depth);
+	return result;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::minNode(rbNode* node) {
+	if (node == nullptr)
+		return nullptr;
+	while (node->left != nullptr)
+		node = node->left;
+	return node;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::maxNode(rbNode* node) {
+	if (node == nullptr)
+		return nullptr;
+	while (node->right != nullptr)
+		node = node->right;
+	return node;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::next(rbNode* node) {
+	if (node->right != nullptr)
+		return minNode(node->right);
+	while (node->parent != nullptr && node == node->parent->right)
+		node = node->parent;
+	return node->parent;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::prev(rbNode* node) {
+	if (node->left != nullptr)
+		return maxNode(node->left);
+	while (node->parent != nullptr && node == node->parent->left)
+		node = node->parent;
+	return node->parent;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key> requires LookupKey<Compare, Key, K>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::remove(const Key& key) {
+	rbNode* curr = findNode(key);
+	if (curr == nullptr)
 		return 0;
 
 	this->removeNode(curr);
@@ -146,136 +528,142 @@ bool RedBlackTree<K, T>::remove(const K key) {
 	return 1;
 }
 
-template<class K, class T>
-void RedBlackTree<K, T>::removeNode(rbNode* node) {
-	if (node->color == RED) {
-		if (node->left != nullptr && node->right != nullptr) {
-			auto successor = node->right;
-			while (successor->left != nullptr)
-				successor = successor->left;
-			node->key = successor->key;
-			node->val = successor->val;
-			this->removeNode(successor);
-		}
-		else if (node->left != nullptr) {
-			node->key = node->left->key;
-			node->val = node->left->val;
-			node->color = node->left->color;
-			this->removeNode(node->left);
-		}
-		else if (node->right != nullptr) {
-			node->key = node->right->key;
-			node->val = node->right->val;
-			node->color = node->right->color;
-			this->removeNode(node->right);
-		}
-		else {
-			if (node->parent == nullptr) {
-				root = nullptr;
-				delete(node);
-				return;
-			}
+// Puts v (possibly null) in u's place under u's parent.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::transplant(rbNode* u, rbNode* v) {
+	if (u->parent == nullptr)
+		root = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
 
-			if (node->parent->left == node)
-				node->parent->left = nullptr;
-			else
-				node->parent->right = nullptr;
+	if (v != nullptr)
+		v->parent = u->parent;
+}
 
-			delete(node);
-		}
+// Unlinks node, moving its successor into its place when it has two
+// children. Other nodes keep their data, so iterators to them stay valid.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::removeNode(rbNode* node) {
+	Color removed = node->color;
+	rbNode* child;
+	rbNode* parent;
+
+	if (node->left == nullptr) {
+		child = node->right;
+		parent = node->parent;
+		transplant(node, node->right);
+	}
+	else if (node->right == nullptr) {
+		child = node->left;
+		parent = node->parent;
+		transplant(node, node->left);
 	}
 	else {
-		if (node->left != nullptr && node->right != nullptr) {
-			auto successor = node->right;
-			while (successor->left != nullptr)
-				successor = successor->left;
-			node->key = successor->key;
-			node->val = successor->val;
-			this->removeNode(successor);
+		rbNode* successor = minNode(node->right);
+		removed = successor->color;
+		child = successor->right;
+
+		if (successor->parent == node) {
+			parent = successor;
 		}
-		else if (node->left != nullptr) {
-			node->key = node->left->key;
-			node->val = node->left->val;
-			this->removeNode(node->left);
+		else {
+			parent = successor->parent;
+			transplant(successor, successor->right);
+			successor->right = node->right;
+			successor->right->parent = successor;
 		}
-		else if (node->right != nullptr) {
-			node->key = node->right->key;
-			node->val = node->right->val;
-			this->removeNode(node->right);
+
+		transplant(node, successor);
+		successor->left = node->left;
+		successor->left->parent = successor;
+		successor->color = node->color;
+	}
+
+	destroyNode(node);
+	updatePath(parent);
+	if (removed == BLACK)
+		removeFixup(child, parent);
+}
+
+// node carries an extra black; parent is tracked separately because node
+// may be null.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::removeFixup(rbNode* node, rbNode* parent) {
+	while (node != root && !isRed(node))
+	{
+		if (node == parent->left) {
+			rbNode* sibling = parent->right;
+			if (isRed(sibling)) {
+				sibling->color = BLACK;
+				parent->color = RED;
+				leftRotate(parent);
+				sibling = parent->right;
+			}
+			if (!isRed(sibling->left) && !isRed(sibling->right)) {
+				sibling->color = RED;
+				node = parent;
+				parent = node->parent;
+				continue;
+			}
+			if (!isRed(sibling->right)) {
+				sibling->left->color = BLACK;
+				sibling->color = RED;
+				rightRotate(sibling);
+				sibling = parent->right;
+			}
+			sibling->color = parent->color;
+			parent->color = BLACK;
+			sibling->right->color = BLACK;
+			leftRotate(parent);
+			node = root;
 		}
 		else {
-			if (node->parent == nullptr) {
-				delete(node);
-				root = nullptr;
-				return;
+			rbNode* sibling = parent->left;
+			if (isRed(sibling)) {
+				sibling->color = BLACK;
+				parent->color = RED;
+				rightRotate(parent);
+				sibling = parent->left;
 			}
-
-			if (node->parent->left == node) {
-				node->parent->left = nullptr;
-				if (node->parent->right != nullptr
-					&& node->parent->right->color == RED) {
-					node->parent->right->color = BLACK;
-					leftRotate(node->parent);
-				}
+			if (!isRed(sibling->left) && !isRed(sibling->right)) {
+				sibling->color = RED;
+				node = parent;
+				parent = node->parent;
+				continue;
 			}
-			else {
-				node->parent->right = nullptr;
-				if (node->parent->left != nullptr
-					&& node->parent->left->color == RED) {
-					node->parent->left->color = BLACK;
-					rightRotate(node->parent);
-				}
+			if (!isRed(sibling->left)) {
+				sibling->right->color = BLACK;
+				sibling->color = RED;
+				leftRotate(sibling);
+				sibling = parent->left;
 			}
-
-			if (node->parent->left == nullptr
-				&& node->parent->right == nullptr
-				&& node->parent->parent != nullptr) {
-				rightRotate(node->parent->parent);
-			}
-			delete(node);
+			sibling->color = parent->color;
+			parent->color = BLACK;
+			sibling->left->color = BLACK;
+			rightRotate(parent);
+			node = root;
 		}
 	}
+	if (node != nullptr)
+		node->color = BLACK;
 }
 
-template<class K, class T>
-bool RedBlackTree<K, T>::search(const K key, T val) const {
-	auto curr = root;
-	while (curr->left != nullptr | curr->right != nullptr)
-	{
-		if (curr->key == key) {
-			val = curr->val;
-			break;
-		}
-
-		if (cmp(key, curr->key) < 0)
-			curr = curr->left;
-		else
-			curr = curr->right;
-	}
-
-	if (curr->key != key)
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+template<class Key> requires LookupKey<Compare, Key, K>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::search(const Key& key, T& val) const {
+	rbNode* curr = findNode(key);
+	if (curr == nullptr)
 		return 0;
+	val = curr->data.second;
 	return 1;
 }
 
-template<class K, class T>
-int RedBlackTree<K, T>::cmp(const K a, const K b) const {
-	if (typeid(a) == typeid(char*)) {
-		char* x = (char*)a;
-		char* y = (char*)b;
-		return strcmp(x, y);
-	}
-	else {
-		if (a < b) return -1;
-		if (a == b) return 0;
-		if (a > b) return 1;
-	}
-	return 0;
-}
-
-template<class K, class T>
-void RedBlackTree<K, T>::leftRotate(rbNode* node) {
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::leftRotate(rbNode* node) {
 	auto temp = node->right;
+	stats.rotation();
 
 	node->right = temp->left;
 	if (temp->left != nullptr)
@@ -283,6 +671,8 @@ void RedBlackTree<K, T>::leftRotate(rbNode* node) {
 	temp->left = node;
 	temp->parent = node->parent;
 	node->parent = temp;
+	update(node);
+	update(temp);
 
 	if (root == node) {
 		root = temp;
@@ -294,9 +684,10 @@ void RedBlackTree<K, T>::leftRotate(rbNode* node) {
 		temp->parent->right = temp;
 }
 
-template<class K, class T>
-void RedBlackTree<K, T>::rightRotate(rbNode* node) {
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rightRotate(rbNode* node) {
 	auto temp = node->left;
+	stats.rotation();
 
 	node->left = temp->right;
 	if (temp->right != nullptr)
@@ -304,6 +695,8 @@ void RedBlackTree<K, T>::rightRotate(rbNode* node) {
 	temp->right = node;
 	temp->parent = node->parent;
 	node->parent = temp;
+	update(node);
+	update(temp);
 
 	if (root == node) {
 		root = temp;
@@ -315,20 +708,103 @@ void RedBlackTree<K, T>::rightRotate(rbNode* node) {
 		temp->parent->right = temp;
 }
 
-template<class K, class T>
-int RedBlackTree<K, T>::getSize() const {
+// Recomputes node's aggregate from its children
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::update(rbNode* node) {
+	if constexpr (augmented)
+		node->agg = augment.combine(augment.combine(aggregate(node->left), augment.lift(node->data)), aggregate(node->right));
+}
+
+// After a link changed below node: recolouring never changes aggregates,
+// and rotations repair their own two nodes, so only this path is stale.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::updatePath(rbNode* node) {
+	if constexpr (augmented) {
+		for (; node != nullptr; node = node->parent)
+			update(node);
+	}
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+int RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::getSize() const {
 	return this->size;
 }
 
-template<class K, class T>
-void RedBlackTree<K, T>::clear()
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+MemoryFootprint RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::memory_footprint() const {
+	constexpr std::size_t payload = sizeof(std::pair<const K, T>) + sizeof(Color) + 3 * sizeof(rbNode*) + (augmented ? sizeof(aggregate_type) : 0);
+	std::size_t nodes = static_cast<std::size_t>(this->size);
+	return { nodes * sizeof(rbNode), nodes * (sizeof(rbNode) - payload) };
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::verify() const {
+	int count = 0;
+	if (isRed(root) || verify(root, nullptr, count) < 0 || count != this->size)
+		return false;
+	rbNode* last = nullptr;
+	for (rbNode* node = minNode(root); node != nullptr; last = node, node = next(node)) {
+		if (last != nullptr && compare(node->data.first, last->data.first) < 0)
+			return false;
+	}
+	return true;
+}
+
+// Black height of the subtree, or -1 if it breaks an invariant
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+int RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::verify(rbNode* node, rbNode* parent, int& count) const {
+	if (node == nullptr)
+		return 1;
+	if (node->parent != parent || (isRed(node) && (isRed(node->left) || isRed(node->right))))
+		return -1;
+	count++;
+
+	int left = verify(node->left, node, count);
+	int right = verify(node->right, node, count);
+	if (left < 0 || left != right)
+		return -1;
+	return left + (isRed(node) ? 0 : 1);
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::createNode(const K& key, const T& val) {
+	rbNode* node = NodeTraits::allocate(alloc, 1);
+	NodeTraits::construct(alloc, node, key, val, augment.identity());
+	if constexpr (augmented)
+		node->agg = augment.lift(node->data);
+	stats.allocation();
+	return node;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::destroyNode(rbNode* node) {
+	NodeTraits::destroy(alloc, node);
+	NodeTraits::deallocate(alloc, node, 1);
+	stats.deallocation();
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::clear(rbNode* node) {
+	if constexpr (isArenaAllocator<Allocator> && std::is_trivially_destructible_v<K> && std::is_trivially_destructible_v<T>)
+		return;
+
+	if (node != nullptr) {
+		clear(node->left);
+		clear(node->right);
+		destroyNode(node);
+	}
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::clear()
 {
-	delete this->root;
+	clear(this->root);
 	this->root = nullptr;
+	this->size = 0;
 }
 
-template<class K, class T>
-void RedBlackTree<K, T>::printHelper(rbNode* node, std::string indent, bool last) {
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::printHelper(rbNode* node, std::string indent, bool last) {
 	if (node != nullptr) {
 		std::cout << indent;
 		if (last) {
@@ -341,14 +817,103 @@ void RedBlackTree<K, T>::printHelper(rbNode* node, std::string indent, bool last
 		}
 
 		std::string colorStr = (node->color == RED) ? "RED" : "BLACK";
-		std::cout << node->key << "(" << colorStr << ")" << std::endl;
+		std::cout << node->data.first << "(" << colorStr << ")" << std::endl;
 
 		printHelper(node->left, indent, false);
 		printHelper(node->right, indent, true);
 	}
 }
 
-template<class K, class T>
-void RedBlackTree<K, T>:: print() {
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+void RedBlackTree<K, T, Compare, Allocator, Stats, Augment>:: print() {
 	printHelper(root, "", true);
-}
\ No newline at end of file
+}
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::save(std::ostream& out) const {
+	return saveMapSnapshot<K, T>(out, static_cast<std::uint64_t>(this->size), [this](auto&& visit) {
+		for (const auto& [key, val] : *this)
+			visit(key, val);
+	});
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::save(const std::string& path) const {
+	std::ofstream out(path, std::ios::binary);
+	return out && save(out) && out.flush();
+}
+
+// Builds n nodes read in order, halving at each level, so every null link
+// sits at depth redDepth or redDepth + 1. Colouring the nodes at redDepth
+// red then gives all paths the same black height.
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+typename RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::rbNode* RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::build(SnapshotReader& in, std::size_t n, int depth, int redDepth, rbNode* parent, bool& ok) {
+	if (n == 0)
+		return nullptr;
+
+	std::size_t mid = n / 2;
+	rbNode* left = build(in, mid, depth + 1, redDepth, nullptr, ok);
+	K key;
+	T val;
+	if (!ok || !SnapshotCodec<K>::read(in, key) || !SnapshotCodec<T>::read(in, val)) {
+		ok = false;
+		clear(left);
+		return nullptr;
+	}
+
+	rbNode* node = createNode(key, val);
+	node->color = depth == redDepth ? RED : BLACK;
+	node->parent = parent;
+	node->left = left;
+	if (left != nullptr)
+		left->parent = node;
+	node->right = build(in, n - mid - 1, depth + 1, redDepth, node, ok);
+	if (!ok) {
+		clear(node);
+		return nullptr;
+	}
+	update(node);
+	return node;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::restore(SnapshotReader& in) {
+	std::size_t n = static_cast<std::size_t>(in.count());
+	bool ok = true;
+	rbNode* nodes = build(in, n, 0, static_cast<int>(std::bit_width(n)) - 1, nullptr, ok);
+	if (!ok || !in.finish()) {
+		clear(nodes);
+		return false;
+	}
+
+	clear();
+	if (nodes != nullptr)
+		nodes->color = BLACK;
+	this->root = nodes;
+	this->size = static_cast<int>(n);
+	return true;
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::load(std::istream& in) {
+	SnapshotReader reader;
+	return reader.open(in, SnapshotCodec<K>::fixedSize, SnapshotCodec<T>::fixedSize) && restore(reader);
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+bool RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::load(const std::string& path) {
+	SnapshotReader reader;
+	return reader.open(path, SnapshotCodec<K>::fixedSize, SnapshotCodec<T>::fixedSize) && restore(reader);
+}
+
+template<class K, class T, class Compare, class Allocator, class Stats, class Augment>
+StaticSearchTree<K, T> RedBlackTree<K, T, Compare, Allocator, Stats, Augment>::freeze() const {
+	std::vector<K> keys;
+	std::vector<T> values;
+	keys.reserve(this->size);
+	values.reserve(this->size);
+	for (const auto& [key, val] : *this) {
+		keys.push_back(key);
+		values.push_back(val);
+	}
+	return StaticSearchTree<K, T>(std::move(keys), std::move(values));
+}
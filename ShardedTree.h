@@ -0,0 +1,303 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <vector>
+#include "ITree.h"
+
+// Ordered set spread over independent single-threaded trees so several
+// threads can write at once. Keys are range-partitioned: shard i holds the
+// keys from its lower fence up to the next shard's, each shard behind its
+// own reader/writer latch. Lookups take the latch shared (Tree::search
+// must not modify the tree); updates take it exclusively, so writers to
+// different ranges never wait for each other.
+//
+// Shards split when they get hot: after writesPerSplit updates land in
+// one shard, it is cut at its median into two, so a busy key range ends up
+// in more, smaller shards. The shard directory is guarded by its own latch,
+// taken shared by every operation and exclusively only while a split moves
+// keys; a tree with split(key, right) and select(k) (AVLTree) splits in
+// O(log n), anything else moves half its keys one at a time.
+//
+// Tree must implement ITree<T> and either iterate in order with begin(),
+// end() and lower_bound() (BPlusTree) or provide freeze(). Iteration copies
+// only the keys in range, through the iterators or rank and select
+// (AVLTree) when the tree has them; other trees are frozen whole.
+template<typename Tree, typename T>
+class ShardedTree : public ITree<T> {
+    static_assert(std::is_base_of_v<ITree<T>, Tree>, "Tree must implement ITree<T>");
+
+public:
+    using TreeFactory = std::function<std::unique_ptr<Tree>()>;
+
+private:
+    struct Shard {
+        T low{};
+        std::unique_ptr<Tree> tree;
+        mutable std::shared_mutex latch;
+        std::atomic<std::uint64_t> writes{ 0 };
+    };
+
+    // shards[0] has no lower fence; the rest are in ascending fence order
+    std::vector<std::unique_ptr<Shard>> shards;
+    mutable std::shared_mutex directory;
+    TreeFactory makeTree;
+
+    std::uint64_t writesPerSplit = 1 << 16;
+    std::size_t minShardSize = 1024;
+    std::size_t maxShards = 256;
+
+    std::size_t shardIndex(const T& key) const;
+    void wrote(Shard* shard);
+    void split(Shard* shard);
+    template<typename F>
+    void scan(const T* lo, const T* hi, F& f) const;
+
+public:
+    // boundaries, if given, are the initial lower fences of shards 1..n in
+    // ascending order. makeTree creates every shard's tree.
+    explicit ShardedTree(const std::vector<T>& boundaries = {}, TreeFactory makeTree = [] { return std::make_unique<Tree>(); });
+    ShardedTree(const ShardedTree&) = delete;
+    ShardedTree& operator=(const ShardedTree&) = delete;
+
+    void insert(const T& value) override;
+    void remove(const T& value) override;
+    bool search(const T& value) const override;
+    void print() const override;
+
+    std::size_t size() const;
+    std::size_t shard_count() const;
+
+    // Calls f on every key (in [lo, hi]) in ascending order. Each shard is
+    // read under its latch and f runs with no latch held, so f may update
+    // the tree; the keys of one shard form a consistent snapshot, but
+    // shards are read one after another.
+    template<typename F>
+    void for_each(F&& f) const { scan(nullptr, nullptr, f); }
+    template<typename F>
+    void for_each_range(const T& lo, const T& hi, F&& f) const { scan(&lo, &hi, f); }
+
+    // Split a shard after writesPerSplit updates to it (0 never splits),
+    // unless it holds fewer than minShardSize keys or there are already
+    // maxShards shards. Call before the tree is shared between threads.
+    void setSplitPolicy(std::uint64_t writesPerSplit, std::size_t minShardSize, std::size_t maxShards);
+};
+
+template<typename Tree, typename T>
+inline ShardedTree<Tree, T>::ShardedTree(const std::vector<T>& boundaries, TreeFactory makeTree)
+    : makeTree(std::move(makeTree)) {
+    shards.push_back(std::make_unique<Shard>());
+    shards.back()->tree = this->makeTree();
+    for (const T& low : boundaries) {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->low = low;
+        shards.back()->tree = this->makeTree();
+    }
+}
+
+// Last shard whose fence is not above key
+template<typename Tree, typename T>
+inline std::size_t ShardedTree<Tree, T>::shardIndex(const T& key) const {
+    std::size_t lo = 1, hi = shards.size();
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (key < shards[mid]->low)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo - 1;
+}
+
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::insert(const T& value) {
+    Shard* shard;
+    {
+        std::shared_lock<std::shared_mutex> dir(directory);
+        shard = shards[shardIndex(value)].get();
+        std::unique_lock<std::shared_mutex> lock(shard->latch);
+        shard->tree->insert(value);
+    }
+    wrote(shard);
+}
+
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::remove(const T& value) {
+    Shard* shard;
+    {
+        std::shared_lock<std::shared_mutex> dir(directory);
+        shard = shards[shardIndex(value)].get();
+        std::unique_lock<std::shared_mutex> lock(shard->latch);
+        shard->tree->remove(value);
+    }
+    wrote(shard);
+}
+
+template<typename Tree, typename T>
+inline bool ShardedTree<Tree, T>::search(const T& value) const {
+    std::shared_lock<std::shared_mutex> dir(directory);
+    const Shard* shard = shards[shardIndex(value)].get();
+    std::shared_lock<std::shared_mutex> lock(shard->latch);
+    return shard->tree->search(value);
+}
+
+// Shards are never destroyed, so shard stays valid after the directory
+// latch is released. Only the writer that completes a period splits.
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::wrote(Shard* shard) {
+    if (writesPerSplit == 0)
+        return;
+    if (shard->writes.fetch_add(1, std::memory_order_relaxed) + 1 == writesPerSplit)
+        split(shard);
+}
+
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::split(Shard* shard) {
+    std::unique_lock<std::shared_mutex> dir(directory);
+    shard->writes.store(0, std::memory_order_relaxed);
+    if (shards.size() >= maxShards)
+        return;
+
+    auto right = std::make_unique<Shard>();
+    right->tree = makeTree();
+    Tree& tree = *shard->tree;
+
+    if constexpr (requires(Tree& t, const T& key) { t.size(); t.select(std::size_t()); t.split(key, t); }) {
+        // keys are unique: everything after the lower median moves right
+        std::size_t n = tree.size();
+        if (n < std::max<std::size_t>(minShardSize, 2))
+            return;
+        T boundary = *tree.select(n / 2 - 1);
+        right->low = *tree.select(n / 2);
+        tree.split(boundary, *right->tree);
+    }
+    else {
+        std::vector<T> keys;
+        if constexpr (requires(const Tree& t) { t.begin(); t.end(); }) {
+            keys.assign(tree.begin(), tree.end());
+        }
+        else {
+            auto frozen = tree.freeze();
+            keys.assign(frozen.begin(), frozen.begin() + frozen.size());
+        }
+        std::size_t n = keys.size();
+        if (n < std::max<std::size_t>(minShardSize, 2))
+            return;
+        // cut between two different keys, so duplicates stay together
+        std::size_t mid = std::lower_bound(keys.begin(), keys.end(), keys[n / 2]) - keys.begin();
+        if (mid == 0)
+            mid = std::upper_bound(keys.begin(), keys.end(), keys[n / 2]) - keys.begin();
+        if (mid == n)
+            return;
+        right->low = keys[mid];
+        for (std::size_t i = mid; i < n; i++) {
+            right->tree->insert(keys[i]);
+            tree.remove(keys[i]);
+        }
+    }
+
+    auto at = std::find_if(shards.begin(), shards.end(), [&](const auto& s) { return s.get() == shard; });
+    shards.insert(at + 1, std::move(right));
+}
+
+// Walks shard by shard, resuming after each from the next shard's fence,
+// so the directory latch is never held while f runs and concurrent splits
+// only change where the walk lands next.
+template<typename Tree, typename T>
+template<typename F>
+inline void ShardedTree<Tree, T>::scan(const T* lo, const T* hi, F& f) const {
+    if (lo && hi && *hi < *lo)
+        return;
+
+    bool started = lo != nullptr;
+    T from = lo ? *lo : T();
+    while (true) {
+        bool last;
+        T next{};
+        std::vector<T> batch;
+        {
+            std::shared_lock<std::shared_mutex> dir(directory);
+            std::size_t i = started ? shardIndex(from) : 0;
+            last = i + 1 == shards.size();
+            if (!last)
+                next = shards[i + 1]->low;
+
+            std::shared_lock<std::shared_mutex> lock(shards[i]->latch);
+            const Tree& tree = *shards[i]->tree;
+            if constexpr (requires(const Tree& t, const T& key) { t.lower_bound(key); t.begin(); t.end(); }) {
+                auto it = started ? tree.lower_bound(from) : tree.begin();
+                for (; it != tree.end() && !(hi && *hi < *it); ++it)
+                    batch.push_back(*it);
+            }
+            else if constexpr (requires(const Tree& t, const T& key) { t.size(); t.rank(key); t.select(std::size_t()); }) {
+                // keys are unique, as split() assumes for these trees
+                std::size_t first = started ? tree.rank(from) : 0;
+                std::size_t end = hi ? tree.rank(*hi) + (tree.search(*hi) ? 1 : 0) : tree.size();
+                for (std::size_t k = first; k < end; k++)
+                    batch.push_back(*tree.select(k));
+            }
+            else {
+                auto keys = tree.freeze();
+                std::size_t first = started ? keys.lower_bound(from) : 0;
+                std::size_t end = hi ? keys.upper_bound(*hi) : keys.size();
+                if (first < end)
+                    batch.assign(keys.begin() + first, keys.begin() + end);
+            }
+        }
+        for (const T& key : batch)
+            f(key);
+
+        if (last || (hi && *hi < next))
+            return;
+        from = next;
+        started = true;
+    }
+}
+
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::print() const {
+    std::shared_lock<std::shared_mutex> dir(directory);
+    for (std::size_t i = 0; i < shards.size(); i++) {
+        std::shared_lock<std::shared_mutex> lock(shards[i]->latch);
+        if (i == 0)
+            std::cout << "Shard 0:" << std::endl;
+        else
+            std::cout << "Shard " << i << " (from " << shards[i]->low << "):" << std::endl;
+        shards[i]->tree->print();
+    }
+}
+
+template<typename Tree, typename T>
+inline std::size_t ShardedTree<Tree, T>::size() const {
+    std::shared_lock<std::shared_mutex> dir(directory);
+    std::size_t total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard->latch);
+        if constexpr (requires(const Tree& t) { { t.size() } -> std::convertible_to<std::size_t>; })
+            total += shard->tree->size();
+        else
+            total += shard->tree->freeze().size();
+    }
+    return total;
+}
+
+template<typename Tree, typename T>
+inline std::size_t ShardedTree<Tree, T>::shard_count() const {
+    std::shared_lock<std::shared_mutex> dir(directory);
+    return shards.size();
+}
+
+template<typename Tree, typename T>
+inline void ShardedTree<Tree, T>::setSplitPolicy(std::uint64_t writesPerSplit, std::size_t minShardSize, std::size_t maxShards) {
+    this->writesPerSplit = writesPerSplit;
+    this->minShardSize = minShardSize;
+    this->maxShards = maxShards;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include "SplayTree.h"
+
+// SplayTree behind a reader/writer lock, in read-mostly mode. Lookups run
+// under the shared lock without touching the tree; the few that the splay
+// policy picks then take the exclusive lock to splay, so hot or deep keys
+// still move up while most reads proceed in parallel.
+template <typename T, typename Allocator = std::allocator<T>>
+class SharedSplayTree {
+public:
+    explicit SharedSplayTree(unsigned sampleEvery = 64, int depthThreshold = 32, const Allocator& allocator = Allocator())
+        : tree(allocator) {
+        tree.setSplayPolicy(sampleEvery, depthThreshold);
+    }
+    SharedSplayTree(const SharedSplayTree&) = delete;
+    SharedSplayTree& operator=(const SharedSplayTree&) = delete;
+
+    void insert(const T& key) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        tree.insert(key);
+    }
+
+    void remove(const T& key) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        tree.remove(key);
+    }
+
+    bool contains(const T& key) {
+        int depth;
+        bool found;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            found = tree.lookup(key, depth);
+        }
+        if (tree.shouldSplay(depth)) {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            tree.splayTo(key);
+        }
+        return found;
+    }
+
+    void print() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        tree.print();
+    }
+
+private:
+    mutable std::shared_mutex mutex;
+    SplayTree<T, Allocator> tree;
+};
@@ -0,0 +1,313 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TREELIB_HAS_MMAP 1
+#endif
+
+// Binary tree snapshots. A snapshot is a fixed header, the keys (and
+// values) in ascending order, and a checksum of that payload:
+//
+//   magic  version  keySize  valueSize  count  payloadBytes | payload | checksum
+//
+// keySize and valueSize are the codecs' fixed sizes, 0 for variable-size
+// types; sets store snapshotNoValue. Everything is in native byte order,
+// so a snapshot loads on machines of the same architecture, and a
+// mismatched one fails on the magic. The checksum is FNV-1a over 64-bit
+// words of the payload.
+
+inline constexpr std::uint32_t snapshotMagic = 0x50414e53;  // "SNAP"
+inline constexpr std::uint32_t snapshotVersion = 1;
+inline constexpr std::uint32_t snapshotNoValue = 0xffffffffu;
+
+struct SnapshotHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t keySize;
+    std::uint32_t valueSize;
+    std::uint64_t count;
+    std::uint64_t payloadBytes;
+};
+
+inline std::uint64_t snapshotHash(std::uint64_t hash, const char* data, std::size_t n) {
+    constexpr std::uint64_t prime = 0x100000001b3ull;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < n; i++)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    return hash;
+}
+
+// Buffers the payload and writes it in blocks, hashing each block on the
+// way out. Blocks are a multiple of 8 bytes, so the reader, which hashes
+// the same blocks, gets the same checksum.
+class SnapshotWriter {
+public:
+    static constexpr std::size_t blockSize = 64 * 1024;
+
+    SnapshotWriter(std::ostream& out, std::uint32_t keySize, std::uint32_t valueSize, std::uint64_t count, std::uint64_t payloadBytes)
+        : out(out), expected(payloadBytes) {
+        SnapshotHeader header{ snapshotMagic, snapshotVersion, keySize, valueSize, count, payloadBytes };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        buffer.reserve(blockSize);
+    }
+
+    void write(const void* data, std::size_t n) {
+        const char* bytes = static_cast<const char*>(data);
+        while (n > 0) {
+            std::size_t chunk = std::min(n, blockSize - buffer.size());
+            buffer.insert(buffer.end(), bytes, bytes + chunk);
+            bytes += chunk;
+            n -= chunk;
+            if (buffer.size() == blockSize)
+                flush();
+        }
+    }
+
+    // Writes the checksum. False if the stream failed or the codecs wrote
+    // a different amount than the header promised.
+    bool finish() {
+        flush();
+        out.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        return written == expected && out.good();
+    }
+
+private:
+    void flush() {
+        hash = snapshotHash(hash, buffer.data(), buffer.size());
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    std::ostream& out;
+    std::vector<char> buffer;
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+    std::uint64_t written = 0;
+    std::uint64_t expected;
+};
+
+// Reads a snapshot from a stream, in blocks, or from a memory-mapped
+// file, in place. Either way the payload is hashed a block at a time as
+// it is consumed, and finish() checks the result.
+class SnapshotReader {
+public:
+    static constexpr std::size_t blockSize = SnapshotWriter::blockSize;
+
+    SnapshotReader() = default;
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+    ~SnapshotReader() { unmap(); }
+
+    bool open(std::istream& in, std::uint32_t keySize, std::uint32_t valueSize) {
+        stream = &in;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            return false;
+        remaining = header.payloadBytes;
+        return valid(keySize, valueSize);
+    }
+
+    bool open(const std::string& path, std::uint32_t keySize, std::uint32_t valueSize) {
+#ifdef TREELIB_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(header) + sizeof(std::uint64_t))) {
+            ::close(fd);
+            return false;
+        }
+        mappedSize = static_cast<std::size_t>(info.st_size);
+        void* mapping = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            mappedSize = 0;
+            return false;
+        }
+        ::madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+        mapped = static_cast<const char*>(mapping);
+
+        std::memcpy(&header, mapped, sizeof(header));
+        next = mapped + sizeof(header);
+        remaining = header.payloadBytes;
+        return valid(keySize, valueSize) && header.payloadBytes <= mappedSize - sizeof(header) - sizeof(std::uint64_t);
+#else
+        file.open(path, std::ios::binary);
+        return file && open(file, keySize, valueSize);
+#endif
+    }
+
+    std::uint64_t count() const { return header.count; }
+    // Payload bytes not yet consumed; codecs check lengths against it.
+    std::uint64_t available() const { return remaining + static_cast<std::uint64_t>(end - cur); }
+
+    bool read(void* data, std::size_t n) {
+        char* bytes = static_cast<char*>(data);
+        while (n > 0) {
+            if (cur == end && !refill())
+                return false;
+            std::size_t chunk = std::min(n, static_cast<std::size_t>(end - cur));
+            std::memcpy(bytes, cur, chunk);
+            cur += chunk;
+            bytes += chunk;
+            n -= chunk;
+        }
+        return true;
+    }
+
+    // True if the whole payload was consumed and matches the checksum.
+    bool finish() {
+        if (cur != end || remaining != 0)
+            return false;
+
+        std::uint64_t expected;
+        if (mapped != nullptr)
+            std::memcpy(&expected, next, sizeof(expected));
+        else if (!stream->read(reinterpret_cast<char*>(&expected), sizeof(expected)))
+            return false;
+        return expected == hash;
+    }
+
+private:
+    bool valid(std::uint32_t keySize, std::uint32_t valueSize) const {
+        if (header.magic != snapshotMagic || header.version != snapshotVersion)
+            return false;
+        if (header.keySize != keySize || header.valueSize != valueSize)
+            return false;
+        if (keySize != 0 && valueSize != 0) {
+            std::uint64_t entry = keySize + (valueSize == snapshotNoValue ? 0 : valueSize);
+            return header.payloadBytes == header.count * entry;
+        }
+        return true;
+    }
+
+    bool refill() {
+        if (remaining == 0)
+            return false;
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, blockSize));
+
+        if (mapped != nullptr) {
+            cur = next;
+            next += n;
+        }
+        else {
+            buffer.resize(n);
+            if (!stream->read(buffer.data(), static_cast<std::streamsize>(n)))
+                return false;
+            cur = buffer.data();
+        }
+        end = cur + n;
+        remaining -= n;
+        hash = snapshotHash(hash, cur, n);
+        return true;
+    }
+
+    void unmap() {
+#ifdef TREELIB_HAS_MMAP
+        if (mapped != nullptr)
+            ::munmap(const_cast<char*>(mapped), mappedSize);
+#endif
+    }
+
+    SnapshotHeader header{};
+    std::istream* stream = nullptr;
+    std::vector<char> buffer;
+    const char* mapped = nullptr;
+    const char* next = nullptr;
+    std::size_t mappedSize = 0;
+#ifndef TREELIB_HAS_MMAP
+    std::ifstream file;
+#endif
+    const char* cur = nullptr;
+    const char* end = nullptr;
+    std::uint64_t remaining = 0;
+    std::uint64_t hash = 0xcbf29ce484222325ull;
+};
+
+// How a key or value type is stored. Trivially copyable types are copied
+// as raw bytes; specialize for anything else. fixedSize is 0 for types
+// whose encoding varies in length, which then report it through size().
+template<typename T>
+struct SnapshotCodec {
+    static_assert(std::is_trivially_copyable_v<T>, "specialize SnapshotCodec for types that are not trivially copyable");
+
+    static constexpr std::uint32_t fixedSize = sizeof(T);
+
+    static std::size_t size(const T&) { return sizeof(T); }
+    static void write(SnapshotWriter& out, const T& value) { out.write(&value, sizeof(T)); }
+    static bool read(SnapshotReader& in, T& value) { return in.read(&value, sizeof(T)); }
+};
+
+// Length-prefixed
+template<>
+struct SnapshotCodec<std::string> {
+    static constexpr std::uint32_t fixedSize = 0;
+
+    static std::size_t size(const std::string& value) { return sizeof(std::uint64_t) + value.size(); }
+
+    static void write(SnapshotWriter& out, const std::string& value) {
+        std::uint64_t length = value.size();
+        out.write(&length, sizeof(length));
+        out.write(value.data(), value.size());
+    }
+
+    static bool read(SnapshotReader& in, std::string& value) {
+        std::uint64_t length;
+        if (!in.read(&length, sizeof(length)) || length > in.available())
+            return false;
+        value.resize(static_cast<std::size_t>(length));
+        return in.read(value.data(), value.size());
+    }
+};
+
+// Writes a set snapshot of count keys; forEach(visit) must call visit on
+// every key in ascending order.
+template<typename T, typename ForEach>
+bool saveSnapshot(std::ostream& out, std::uint64_t count, ForEach forEach) {
+    using Codec = SnapshotCodec<T>;
+
+    std::uint64_t bytes = count * Codec::fixedSize;
+    if constexpr (Codec::fixedSize == 0)
+        forEach([&](const T& key) { bytes += Codec::size(key); });
+
+    SnapshotWriter writer(out, Codec::fixedSize, snapshotNoValue, count, bytes);
+    forEach([&](const T& key) { Codec::write(writer, key); });
+    return writer.finish();
+}
+
+// Map snapshot; visit takes a key and its value.
+template<typename K, typename V, typename ForEach>
+bool saveMapSnapshot(std::ostream& out, std::uint64_t count, ForEach forEach) {
+    using KeyCodec = SnapshotCodec<K>;
+    using ValueCodec = SnapshotCodec<V>;
+
+    std::uint64_t bytes = count * (KeyCodec::fixedSize + ValueCodec::fixedSize);
+    if constexpr (KeyCodec::fixedSize == 0 || ValueCodec::fixedSize == 0) {
+        bytes = 0;
+        forEach([&](const K& key, const V& value) { bytes += KeyCodec::size(key) + ValueCodec::size(value); });
+    }
+
+    SnapshotWriter writer(out, KeyCodec::fixedSize, ValueCodec::fixedSize, count, bytes);
+    forEach([&](const K& key, const V& value) {
+        KeyCodec::write(writer, key);
+        ValueCodec::write(writer, value);
+    });
+    return writer.finish();
+}
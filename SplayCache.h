@@ -0,0 +1,164 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include "SplayTree.h"
+
+// Node payload of SplayCache. Ordered by key alone, and comparable with a
+// bare key so the tree can splay on K directly.
+template <typename K, typename V>
+struct SplayCacheEntry {
+    K key;
+    V value;
+    std::size_t bytes;
+    std::uint64_t lastUse;
+
+    friend bool operator<(const SplayCacheEntry& a, const SplayCacheEntry& b) { return a.key < b.key; }
+    friend bool operator<(const SplayCacheEntry& a, const K& b) { return a.key < b; }
+    friend bool operator<(const K& a, const SplayCacheEntry& b) { return a < b.key; }
+    friend bool operator==(const SplayCacheEntry& a, const SplayCacheEntry& b) { return a.key == b.key; }
+    friend bool operator==(const SplayCacheEntry& a, const K& b) { return a.key == b; }
+    friend std::ostream& operator<<(std::ostream& out, const SplayCacheEntry& entry) { return out << entry.key; }
+};
+
+// Bounded key-value cache on top of SplayTree. Every get and put splays
+// the key to the root, so recently used entries stay near the top and
+// stale ones sink towards the leaves. When the entry or byte budget is
+// exceeded, a few random root-to-leaf descents each propose the node they
+// end at, and the one least recently used is evicted. The descents are
+// capped in depth, so a degenerate chain costs no more than a balanced
+// tree. Not thread-safe.
+template <typename K, typename V, typename Allocator = std::allocator<SplayCacheEntry<K, V>>>
+class SplayCache : private SplayTree<SplayCacheEntry<K, V>, Allocator> {
+private:
+    using Entry = SplayCacheEntry<K, V>;
+    using Base = SplayTree<Entry, Allocator>;
+    using Node = typename Base::Node;
+    using Base::root;
+
+    static constexpr int evictionSamples = 5;
+    // one random bit per level
+    static constexpr int maxDescent = 64;
+
+    std::size_t maxEntries;
+    std::size_t maxBytes;
+    std::size_t count = 0;
+    std::size_t used = 0;
+    std::uint64_t clock = 0;
+    std::uint64_t rng = 0x9e3779b97f4a7c15ull;
+    std::size_t hitCount = 0;
+    std::size_t missCount = 0;
+    std::size_t evictionCount = 0;
+
+    void evict();
+    void unlinkRoot();
+    std::uint64_t nextRandom();
+
+public:
+    // Either limit may be 0 for "no limit". An entry's cost counts
+    // against maxBytes; put() defaults it to sizeof(K) + sizeof(V).
+    explicit SplayCache(std::size_t maxEntries, std::size_t maxBytes = 0, const Allocator& allocator = Allocator())
+        : Base(allocator), maxEntries(maxEntries), maxBytes(maxBytes) {}
+
+    // Pointer to the cached value, valid until the next put or erase,
+    // or nullptr on a miss.
+    V* get(const K& key);
+    void put(const K& key, const V& value, std::size_t bytes = sizeof(K) + sizeof(V));
+    bool erase(const K& key);
+
+    std::size_t size() const { return count; }
+    std::size_t bytes() const { return used; }
+    std::size_t hits() const { return hitCount; }
+    std::size_t misses() const { return missCount; }
+    std::size_t evictions() const { return evictionCount; }
+};
+
+template<typename K, typename V, typename Allocator>
+inline V* SplayCache<K, V, Allocator>::get(const K& key) {
+    root = this->splay(root, key);
+    if (root == nullptr || !(root->key == key)) {
+        missCount++;
+        return nullptr;
+    }
+
+    hitCount++;
+    root->key.lastUse = ++clock;
+    return &root->key.value;
+}
+
+template<typename K, typename V, typename Allocator>
+inline void SplayCache<K, V, Allocator>::put(const K& key, const V& value, std::size_t bytes) {
+    root = this->splay(root, key);
+    if (root != nullptr && root->key == key) {
+        used = used - root->key.bytes + bytes;
+        root->key.value = value;
+        root->key.bytes = bytes;
+        root->key.lastUse = ++clock;
+    }
+    else {
+        auto [left, right] = this->split(root, key);
+        root = this->createNode(Entry{ key, value, bytes, ++clock }, left, right);
+        count++;
+        used += bytes;
+    }
+
+    while (count > 1 && ((maxEntries != 0 && count > maxEntries) || (maxBytes != 0 && used > maxBytes)))
+        evict();
+}
+
+template<typename K, typename V, typename Allocator>
+inline bool SplayCache<K, V, Allocator>::erase(const K& key) {
+    root = this->splay(root, key);
+    if (root == nullptr || !(root->key == key))
+        return false;
+
+    unlinkRoot();
+    return true;
+}
+
+// Removes the root node, which the caller has just splayed there.
+template<typename K, typename V, typename Allocator>
+inline void SplayCache<K, V, Allocator>::unlinkRoot() {
+    Node* old = root;
+    count--;
+    used -= old->key.bytes;
+    root = this->merge(old->left, old->right);
+    this->destroyNode(old);
+}
+
+template<typename K, typename V, typename Allocator>
+inline void SplayCache<K, V, Allocator>::evict() {
+    Node* victim = nullptr;
+    for (int s = 0; s < evictionSamples; s++) {
+        Node* node = root;
+        std::uint64_t bits = nextRandom();
+        for (int depth = 0; depth < maxDescent; depth++, bits >>= 1) {
+            Node* next = (bits & 1) ? node->left : node->right;
+            if (next == nullptr)
+                next = node->left != nullptr ? node->left : node->right;
+            if (next == nullptr)
+                break;
+            node = next;
+        }
+        // the root was splayed by the call that got us here
+        if (node != root && (victim == nullptr || node->key.lastUse < victim->key.lastUse))
+            victim = node;
+    }
+    if (victim == nullptr)
+        return;
+
+    // the copy keeps the key alive while the tree reshapes around it
+    K key = victim->key.key;
+    root = this->splay(root, key);
+    unlinkRoot();
+    evictionCount++;
+}
+
+template<typename K, typename V, typename Allocator>
+inline std::uint64_t SplayCache<K, V, Allocator>::nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
@@ -1,197 +1,330 @@
 #pragma once
+#include <cstdint>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "Allocator.h"
+#include "ITree.h"
+#include "Snapshot.h"
+#include "StaticSearchTree.h"
+#include "TreeStats.h"
 
-template <typename T>
-class SplayTree {
-private:
+template <typename T, typename Allocator = std::allocator<T>, typename Stats = NullStats>
+class SplayTree : public ITree<T> {
+protected:
     struct Node {
         T key;
         Node* left;
         Node* right;
-        Node* parent;
 
-        Node(T k, Node* l = nullptr, Node* r = nullptr, Node* p = nullptr)
-            : key(k), left(l), right(r), parent(p) {}
+        Node(T k, Node* l = nullptr, Node* r = nullptr)
+            : key(k), left(l), right(r) {}
     };
 
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
     Node* root;
+    NodeAllocator alloc;
+    std::size_t nodeCount = 0;
+    [[no_unique_address]] mutable Stats stats;
+    unsigned sampleEvery = 1;
+    int depthThreshold = 0;
 
-    void setParent(Node* child, Node* parent);
-    void keepParent(Node* v);
-    void rotate(Node* parent, Node* child);
-    Node* splay(Node* v);
-    Node* find(Node* v, T key);
-    std::pair<Node*, Node*> split(Node* root, T key) {
+    Node* createNode(T key, Node* left, Node* right);
+    void destroyNode(Node* node);
+    // Key may be any type ordered against T with <, e.g. the key part of
+    // a key-value entry.
+    template<typename Key>
+    Node* splay(Node* v, const Key& key);
+    template<typename Key>
+    std::pair<Node*, Node*> split(Node* root, const Key& key) {
         if (root == nullptr) {
             return { nullptr, nullptr };
         }
 
-        root = find(root, key);
+        root = splay(root, key);
 
         if (root->key == key) {
-            setParent(root->left, nullptr);
-            setParent(root->right, nullptr);
-            return { root->left, root->right };
+            Node* left = root->left;
+            Node* right = root->right;
+            destroyNode(root);
+            return { left, right };
         }
 
         if (root->key < key) {
             Node* right = root->right;
             root->right = nullptr;
-            setParent(right, nullptr);
             return { root, right };
         }
         else {
             Node* left = root->left;
             root->left = nullptr;
-            setParent(left, nullptr);
             return { left, root };
         }
     }
     Node* merge(Node* left, Node* right);
     void clear(Node* node);
     void print(Node* node, int depth = 0) const;
+    Node* build(SnapshotReader& in, std::size_t n, bool& ok);
+    template<typename F>
+    void visit(F&& f) const;
+    bool restore(SnapshotReader& in);
 
 public:
     SplayTree() : root(nullptr) {}
+    explicit SplayTree(const Allocator& allocator) : root(nullptr), alloc(allocator) {}
+    SplayTree(const SplayTree&) = delete;
+    SplayTree& operator=(const SplayTree&) = delete;
     ~SplayTree() { clear(root); }
-    void insert(T key);
-    void remove(T key);
+    void insert(const T& key) override;
+    void remove(const T& key) override;
     bool contains(T key);
-    void print() const;
+    // Same as lookup(): never splays, so it is safe under a shared lock
+    bool search(const T& key) const override { return lookup(key); }
+    void print() const override;
+
+    // Read-mostly mode. contains() first searches without restructuring
+    // and only splays when the key sat deeper than depthThreshold, or on
+    // about one access in sampleEvery (0 turns sampling off). The default,
+    // (1, 0), splays on every access.
+    void setSplayPolicy(unsigned sampleEvery, int depthThreshold);
+
+    // Plain search that never modifies the tree, so concurrent lookups
+    // are safe as long as nothing writes. depth is the number of nodes
+    // visited.
+    bool lookup(const T& key) const;
+    bool lookup(const T& key, int& depth) const;
+    // Whether an access that went depth nodes deep should be splayed
+    // under the current policy. Safe to call concurrently.
+    bool shouldSplay(int depth) const;
+    // Splays key (or its neighbour) to the root.
+    void splayTo(const T& key);
+
+    // Snapshots (see Snapshot.h). load rebuilds a perfectly balanced tree
+    // in O(n) with no comparisons or rotations, and on failure returns
+    // false with the tree unchanged. load(path) maps the file.
+    bool save(std::ostream& out) const;
+    bool save(const std::string& path) const;
+    bool load(std::istream& in);
+    bool load(const std::string& path);
+
+    // Immutable copy for lookups once the tree stops changing
+    StaticSearchTree<T> freeze() const;
+
+    const Stats& getStats() const { return stats; }
+    MemoryFootprint memory_footprint() const;
 };
 
-template<typename T>
-inline void SplayTree<T>::setParent(Node* child, Node* parent) {
-    if (child != nullptr) {
-        child->parent = parent;
-    }
+template<typename T, typename Allocator, typename Stats>
+inline typename SplayTree<T, Allocator, Stats>::Node* SplayTree<T, Allocator, Stats>::createNode(T key, Node* left, Node* right) {
+    Node* node = NodeTraits::allocate(alloc, 1);
+    NodeTraits::construct(alloc, node, key, left, right);
+    nodeCount++;
+    stats.allocation();
+    return node;
 }
 
-template<typename T>
-inline void SplayTree<T>::keepParent(Node* v) {
-    setParent(v->left, v);
-    setParent(v->right, v);
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::destroyNode(Node* node) {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
+    nodeCount--;
+    stats.deallocation();
 }
 
-template<typename T>
-inline void SplayTree<T>::rotate(Node* parent, Node* child) {
-    Node* gparent = parent->parent;
+// Top-down splay: one pass from the root, no recursion and no parent
+// links. Nodes passed on the way down are hung off the left tree (keys
+// below key) or the right tree (keys above), rotating once more on
+// zig-zig steps, and both trees become the children of the node the
+// search ends at.
+template<typename T, typename Allocator, typename Stats>
+template<typename Key>
+inline typename SplayTree<T, Allocator, Stats>::Node* SplayTree<T, Allocator, Stats>::splay(Node* v, const Key& key) {
+    if (v == nullptr) return nullptr;
+
+    Node* leftTree = nullptr;
+    Node* rightTree = nullptr;
+    Node** leftHook = &leftTree;
+    Node** rightHook = &rightTree;
+    int depth = 1;
 
-    if (gparent != nullptr) {
-        if (gparent->left == parent) {
-            gparent->left = child;
+    while (true) {
+        stats.comparison();
+        if (key < v->key) {
+            if (v->left == nullptr) break;
+            stats.comparison();
+            if (key < v->left->key) {
+                Node* child = v->left;
+                v->left = child->right;
+                child->right = v;
+                v = child;
+                stats.rotation();
+                depth++;
+                if (v->left == nullptr) break;
+            }
+            *rightHook = v;
+            rightHook = &v->left;
+            v = v->left;
+            depth++;
+        }
+        else if (v->key < key) {
+            if (v->right == nullptr) break;
+            stats.comparison();
+            if (v->right->key < key) {
+                Node* child = v->right;
+                v->right = child->left;
+                child->left = v;
+                v = child;
+                stats.rotation();
+                depth++;
+                if (v->right == nullptr) break;
+            }
+            *leftHook = v;
+            leftHook = &v->right;
+            v = v->right;
+            depth++;
         }
         else {
-            gparent->right = child;
+            break;
         }
     }
+    stats.splay(depth);
+    stats.depth(depth);
 
-    if (parent->left == child) {
-        parent->left = child->right;
-        child->right = parent;
-    }
-    else {
-        parent->right = child->left;
-        child->left = parent;
-    }
-
-    keepParent(child);
-    keepParent(parent);
-    child->parent = gparent;
+    *leftHook = v->left;
+    *rightHook = v->right;
+    v->left = leftTree;
+    v->right = rightTree;
+    return v;
 }
 
-template<typename T>
-inline SplayTree<T>::Node* SplayTree<T>::splay(Node* v) {
-    if (v->parent == nullptr) {
-        return v;
-    }
+template<typename T, typename Allocator, typename Stats>
+inline typename SplayTree<T, Allocator, Stats>::Node* SplayTree<T, Allocator, Stats>::merge(Node* left, Node* right) {
+    if (right == nullptr) return left;
+    if (left == nullptr) return right;
 
-    Node* parent = v->parent;
-    Node* gparent = parent->parent;
+    right = splay(right, left->key);
+    right->left = left;
+    return right;
+}
 
-    if (gparent == nullptr) {
-        rotate(parent, v);
-        return v;
-    }
-    else {
-        bool zigzig = (gparent->left == parent) == (parent->left == v);
-        if (zigzig) {
-            rotate(gparent, parent);
-            rotate(parent, v);
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::clear(Node* node) {
+    if constexpr (isArenaAllocator<Allocator> && std::is_trivially_destructible_v<T>)
+        return;
+
+    // rotates left children up so that every freed node has none
+    while (node != nullptr) {
+        if (node->left != nullptr) {
+            Node* child = node->left;
+            node->left = child->right;
+            child->right = node;
+            node = child;
         }
         else {
-            rotate(parent, v);
-            rotate(gparent, v);
+            Node* next = node->right;
+            destroyNode(node);
+            node = next;
         }
-        return splay(v);
     }
-};
-
-template<typename T>
-inline SplayTree<T>::Node* SplayTree<T>::find(Node* v, T key) {
-    if (v == nullptr) return nullptr;
+}
 
-    if (key == v->key) {
-        return splay(v);
-    }
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::insert(const T& key) {
+    auto [left, right] = split(root, key);
+    root = createNode(key, left, right);
+}
 
-    if (key < v->key && v->left != nullptr) {
-        return find(v->left, key);
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::remove(const T& key) {
+    root = splay(root, key);
+    if (root != nullptr && root->key == key) {
+        Node* old = root;
+        root = merge(root->left, root->right);
+        destroyNode(old);
     }
+}
 
-    if (key > v->key && v->right != nullptr) {
-        return find(v->right, key);
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::contains(T key) {
+    if (sampleEvery == 1) {
+        root = splay(root, key);
+        return root != nullptr && root->key == key;
     }
 
-    return splay(v);
+    int depth;
+    bool found = lookup(key, depth);
+    if (shouldSplay(depth))
+        root = splay(root, key);
+    return found;
 }
 
-template<typename T>
-inline SplayTree<T>::Node* SplayTree<T>::merge(Node* left, Node* right) {
-    if (right == nullptr) return left;
-    if (left == nullptr) return right;
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::setSplayPolicy(unsigned sampleEvery, int depthThreshold) {
+    this->sampleEvery = sampleEvery;
+    this->depthThreshold = depthThreshold;
+}
 
-    right = find(right, left->key);
-    right->left = left;
-    left->parent = right;
-    return right;
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::lookup(const T& key) const {
+    int depth;
+    return lookup(key, depth);
 }
 
-template<typename T>
-inline void SplayTree<T>::clear(Node* node) {
-    if (node != nullptr) {
-        clear(node->left);
-        clear(node->right);
-        delete node;
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::lookup(const T& key, int& depth) const {
+    depth = 0;
+    bool found = false;
+    for (Node* node = root; node != nullptr;) {
+        depth++;
+        stats.comparison();
+        if (key < node->key)
+            node = node->left;
+        else if (node->key < key)
+            node = node->right;
+        else {
+            found = true;
+            break;
+        }
     }
+    stats.depth(depth);
+    return found;
 }
 
-template<typename T>
-inline void SplayTree<T>::insert(T key) {
-    auto [left, right] = split(root, key);
-    root = new Node(key, left, right);
-    keepParent(root);
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::shouldSplay(int depth) const {
+    if (depth > depthThreshold) return true;
+    if (sampleEvery == 0) return false;
+    if (sampleEvery == 1) return true;
+
+    // per-thread xorshift, so sampling adds no shared writes
+    thread_local std::uint32_t state = static_cast<std::uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % sampleEvery == 0;
 }
 
-template<typename T>
-inline void SplayTree<T>::remove(T key) {
-    root = find(root, key);
-    if (root != nullptr && root->key == key) {
-        setParent(root->left, nullptr);
-        setParent(root->right, nullptr);
-        root = merge(root->left, root->right);
-    }
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::splayTo(const T& key) {
+    root = splay(root, key);
 }
 
-template<typename T>
-inline bool SplayTree<T>::contains(T key) {
-    root = find(root, key);
-    return root != nullptr && root->key == key;
+// Nodes carry no bookkeeping beyond their two links, so the only slack
+// is the padding the compiler adds around the key.
+template<typename T, typename Allocator, typename Stats>
+inline MemoryFootprint SplayTree<T, Allocator, Stats>::memory_footprint() const {
+    constexpr std::size_t padding = sizeof(Node) - sizeof(T) - 2 * sizeof(Node*);
+    return { nodeCount * sizeof(Node), nodeCount * padding };
 }
 
-template<typename T>
-inline void SplayTree<T>::print(Node* node, int depth) const {
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::print(Node* node, int depth) const {
     if (node != nullptr) {
         print(node->right, depth + 1);
         std::cout << std::string(depth * 4, ' ') << node->key << std::endl;
@@ -199,8 +332,95 @@ inline void SplayTree<T>::print(Node* node, int depth) const {
     }
 }
 
-template<typename T>
-inline void SplayTree<T>::print() const {
+template<typename T, typename Allocator, typename Stats>
+inline void SplayTree<T, Allocator, Stats>::print() const {
     print(root);
     std::cout << "----------------" << std::endl;
-}
\ No newline at end of file
+}
+// In-order walk. The tree may be a long chain, so it keeps its own stack.
+template<typename T, typename Allocator, typename Stats>
+template<typename F>
+inline void SplayTree<T, Allocator, Stats>::visit(F&& f) const {
+    std::vector<Node*> stack;
+    Node* node = root;
+    while (node != nullptr || !stack.empty()) {
+        for (; node != nullptr; node = node->left)
+            stack.push_back(node);
+        node = stack.back();
+        stack.pop_back();
+        f(node->key);
+        node = node->right;
+    }
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::save(std::ostream& out) const {
+    return saveSnapshot<T>(out, nodeCount, [this](auto&& f) { visit(f); });
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    return out && save(out) && out.flush();
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline typename SplayTree<T, Allocator, Stats>::Node* SplayTree<T, Allocator, Stats>::build(SnapshotReader& in, std::size_t n, bool& ok) {
+    if (n == 0) return nullptr;
+
+    std::size_t mid = n / 2;
+    Node* left = build(in, mid, ok);
+    T key;
+    if (!ok || !SnapshotCodec<T>::read(in, key)) {
+        ok = false;
+        clear(left);
+        return nullptr;
+    }
+
+    Node* node = createNode(key, left, nullptr);
+    node->right = build(in, n - mid - 1, ok);
+    if (!ok) {
+        clear(node);
+        return nullptr;
+    }
+    return node;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::restore(SnapshotReader& in) {
+    // set explicitly, since clear() skips the nodes on an arena
+    std::size_t before = nodeCount;
+    std::size_t n = static_cast<std::size_t>(in.count());
+    bool ok = true;
+    Node* nodes = build(in, n, ok);
+    if (!ok || !in.finish()) {
+        clear(nodes);
+        nodeCount = before;
+        return false;
+    }
+
+    clear(root);
+    root = nodes;
+    nodeCount = n;
+    return true;
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::load(std::istream& in) {
+    SnapshotReader reader;
+    return reader.open(in, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline bool SplayTree<T, Allocator, Stats>::load(const std::string& path) {
+    SnapshotReader reader;
+    return reader.open(path, SnapshotCodec<T>::fixedSize, snapshotNoValue) && restore(reader);
+}
+
+template<typename T, typename Allocator, typename Stats>
+inline StaticSearchTree<T> SplayTree<T, Allocator, Stats>::freeze() const {
+    std::vector<T> keys;
+    keys.reserve(nodeCount);
+    visit([&keys](const T& key) { keys.push_back(key); });
+    return StaticSearchTree<T>(std::move(keys));
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "KeySearch.h"
+#include "TreeStats.h"
+
+// Immutable search tree for data that is built once and then only read,
+// produced by freeze() on the trees or built directly from sorted keys.
+//
+// The keys sit in one sorted array, cut into blocks of a cache line.
+// The first key of every block goes into a separate Eytzinger array (the
+// implicit binary tree in BFS order: children of k at 2k and 2k + 1), a
+// sixteenth of the data for int keys, so its upper levels stay cached. A
+// lookup walks that array without branches, prefetching the line four
+// levels below, to pick the block, then counts inside the block with
+// KeySearch, which uses SIMD for arithmetic keys. Ranges are contiguous
+// slices of the sorted array. V = void makes it a set; otherwise each key
+// has a value stored alongside in the same order. Duplicate keys are
+// allowed.
+template<typename K, typename V = void>
+class StaticSearchTree {
+private:
+    struct NoValues {};
+    using Values = std::conditional_t<std::is_void_v<V>, NoValues, std::vector<std::conditional_t<std::is_void_v<V>, char, V>>>;
+
+    static constexpr std::size_t lineKeys = sizeof(K) >= 64 ? 1 : 64 / sizeof(K);
+    static constexpr std::size_t blockSize = lineKeys;
+
+    std::vector<K> keys;
+    [[no_unique_address]] Values values;
+    // 1-based Eytzinger order; index[0] unused
+    std::vector<K> index;
+    // block number of each index entry
+    std::vector<std::uint32_t> blockOf;
+
+    void buildIndex();
+    std::size_t buildIndex(std::size_t k, std::size_t block);
+    template<bool Strict>
+    std::size_t search(const K& key) const;
+
+public:
+    StaticSearchTree() = default;
+    // keys must be in ascending order
+    explicit StaticSearchTree(std::vector<K> sortedKeys) requires std::is_void_v<V>
+        : keys(std::move(sortedKeys)) {
+        buildIndex();
+    }
+    template<typename U = V> requires (!std::is_void_v<V>)
+    StaticSearchTree(std::vector<K> sortedKeys, std::vector<U> valuesInKeyOrder)
+        : keys(std::move(sortedKeys)), values(std::move(valuesInKeyOrder)) {
+        buildIndex();
+    }
+
+    std::size_t size() const { return keys.size(); }
+    bool empty() const { return keys.empty(); }
+
+    // Positions in ascending key order: the first key not less than /
+    // greater than key, or size().
+    std::size_t lower_bound(const K& key) const { return search<true>(key); }
+    std::size_t upper_bound(const K& key) const { return search<false>(key); }
+    bool contains(const K& key) const;
+
+    const K& key_at(std::size_t i) const { return keys[i]; }
+    template<typename U = V> requires (!std::is_void_v<V>)
+    const U& value_at(std::size_t i) const { return values[i]; }
+    // Value of key, or nullptr
+    template<typename U = V> requires (!std::is_void_v<V>)
+    const U* find(const K& key) const;
+
+    // Keys in [lo, hi], in ascending order; the matching values are
+    // value_at(lower_bound(lo)) onwards.
+    std::span<const K> range(const K& lo, const K& hi) const;
+    std::size_t count_range(const K& lo, const K& hi) const { return range(lo, hi).size(); }
+
+    const K* begin() const { return keys.data(); }
+    const K* end() const { return keys.data() + keys.size(); }
+
+    MemoryFootprint memory_footprint() const;
+};
+
+template<typename K, typename V>
+inline void StaticSearchTree<K, V>::buildIndex() {
+    std::size_t blocks = (keys.size() + blockSize - 1) / blockSize;
+    index.assign(blocks + 1, K());
+    blockOf.assign(blocks + 1, 0);
+    buildIndex(1, 0);
+}
+
+// In-order walk of the implicit tree hands out blocks in ascending order.
+template<typename K, typename V>
+inline std::size_t StaticSearchTree<K, V>::buildIndex(std::size_t k, std::size_t block) {
+    if (k >= index.size())
+        return block;
+    block = buildIndex(2 * k, block);
+    index[k] = keys[block * blockSize];
+    blockOf[k] = static_cast<std::uint32_t>(block);
+    return buildIndex(2 * k + 1, block + 1);
+}
+
+// Finds the first block whose leading key is not below key (Strict) or
+// above it. The answer is then in the block before it, or at its start.
+template<typename K, typename V>
+template<bool Strict>
+inline std::size_t StaticSearchTree<K, V>::search(const K& key) const {
+    const std::size_t blocks = index.size() - 1;
+    if (keys.empty())
+        return 0;
+
+    const K* tree = index.data();
+    std::size_t k = 1;
+    while (k <= blocks) {
+#if defined(__GNUC__) || defined(__clang__)
+        // address arithmetic only; the prefetch may point past the end
+        __builtin_prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(tree) + k * lineKeys * sizeof(K)));
+#endif
+        bool right = Strict ? (tree[k] < key) : !(key < tree[k]);
+        k = 2 * k + right;
+    }
+    // drop the trailing right turns and the last left turn
+    k >>= std::countr_one(k) + 1;
+
+    std::size_t block = k == 0 ? blocks : blockOf[k];
+    if (block == 0)
+        return 0;
+
+    std::size_t base = (block - 1) * blockSize;
+    int n = static_cast<int>(std::min(blockSize, keys.size() - base));
+    int offset = Strict ? KeySearch<K>::lowerBound(keys.data() + base, n, key)
+                        : KeySearch<K>::upperBound(keys.data() + base, n, key);
+    return base + static_cast<std::size_t>(offset);
+}
+
+template<typename K, typename V>
+inline bool StaticSearchTree<K, V>::contains(const K& key) const {
+    std::size_t i = lower_bound(key);
+    return i < keys.size() && !(key < keys[i]);
+}
+
+template<typename K, typename V>
+template<typename U> requires (!std::is_void_v<V>)
+inline const U* StaticSearchTree<K, V>::find(const K& key) const {
+    std::size_t i = lower_bound(key);
+    return i < keys.size() && !(key < keys[i]) ? &values[i] : nullptr;
+}
+
+template<typename K, typename V>
+inline std::span<const K> StaticSearchTree<K, V>::range(const K& lo, const K& hi) const {
+    if (hi < lo)
+        return {};
+    std::size_t first = lower_bound(lo);
+    std::size_t last = upper_bound(hi);
+    return { keys.data() + first, last - first };
+}
+
+// Slack is the unused capacity of the arrays.
+template<typename K, typename V>
+inline MemoryFootprint StaticSearchTree<K, V>::memory_footprint() const {
+    MemoryFootprint total{
+        keys.capacity() * sizeof(K) + index.capacity() * sizeof(K) + blockOf.capacity() * sizeof(std::uint32_t),
+        (keys.capacity() - keys.size()) * sizeof(K)
+    };
+    if constexpr (!std::is_void_v<V>) {
+        total.bytes += values.capacity() * sizeof(V);
+        total.slack += (values.capacity() - values.size()) * sizeof(V);
+    }
+    return total;
+}
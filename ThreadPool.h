@@ -0,0 +1,231 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing pool for fork-join recursion. invoke(a, b) publishes b on
+// the calling thread's deque, runs a itself and then takes b back unless a
+// worker stole it. Workers pop their own deque from the back and steal
+// from the front of the others. A thread waiting for a stolen task keeps
+// running other tasks instead of blocking, so nested invokes cannot starve
+// the pool. Threads outside the pool share one extra deque. Idle workers
+// sleep until a task is published.
+//
+// If a throws, b is taken back, or waited for if it was stolen, before the
+// exception leaves invoke; an exception from a stolen b is rethrown on the
+// calling thread.
+class ThreadPool {
+public:
+    // threads counts the calling thread, so ThreadPool(1) runs everything
+    // inline.
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    unsigned concurrency() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    template<typename A, typename B>
+    void invoke(A&& a, B&& b);
+
+    static ThreadPool& global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    struct Task {
+        void (*call)(void*);
+        void* arg;
+        std::atomic<bool> done{false};
+        std::exception_ptr error;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task*> tasks;
+    };
+
+    struct Current {
+        const ThreadPool* pool = nullptr;
+        unsigned index = 0;
+    };
+
+    static Current& current() {
+        thread_local Current c;
+        return c;
+    }
+
+    unsigned localQueue() const {
+        const Current& c = current();
+        return c.pool == this ? c.index : static_cast<unsigned>(workers.size());
+    }
+
+    void push(unsigned q, Task* task);
+    bool tryRemove(unsigned q, Task* task);
+    Task* take(unsigned self);
+    bool runOne(unsigned self);
+    void join(unsigned q, Task* task);
+    void workerLoop(unsigned index);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<bool> stopping;
+    std::atomic<int> pending;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+};
+
+inline ThreadPool::ThreadPool(unsigned threads) : stopping(false), pending(0) {
+    unsigned count = threads > 1 ? threads - 1 : 0;
+    for (unsigned i = 0; i <= count; i++)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < count; i++)
+        workers.emplace_back([this, i] { workerLoop(i); });
+}
+
+inline ThreadPool::~ThreadPool() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wake.notify_all();
+    }
+    for (auto& w : workers)
+        w.join();
+}
+
+template<typename A, typename B>
+inline void ThreadPool::invoke(A&& a, B&& b) {
+    if (workers.empty()) {
+        a();
+        b();
+        return;
+    }
+
+    using Fn = std::remove_reference_t<B>;
+    Task task;
+    task.call = [](void* p) { (*static_cast<Fn*>(p))(); };
+    task.arg = const_cast<void*>(static_cast<const void*>(&b));
+
+    unsigned q = localQueue();
+    push(q, &task);
+
+    // task points into this frame, so it must not outlive it if a throws
+    struct Guard {
+        ThreadPool* pool;
+        unsigned q;
+        Task* task;
+        bool armed = true;
+        ~Guard() {
+            if (armed && !pool->tryRemove(q, task))
+                pool->join(q, task);
+        }
+    } guard{ this, q, &task };
+    a();
+    guard.armed = false;
+
+    if (tryRemove(q, &task)) {
+        b();
+        return;
+    }
+    join(q, &task);
+    if (task.error)
+        std::rethrow_exception(task.error);
+}
+
+// pending changes under sleepLock, so a worker between checking it and
+// going to sleep cannot miss the notification.
+inline void ThreadPool::push(unsigned q, Task* task) {
+    {
+        std::lock_guard<std::mutex> guard(queues[q]->lock);
+        queues[q]->tasks.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> guard(sleepLock);
+        pending.fetch_add(1, std::memory_order_release);
+    }
+    wake.notify_one();
+}
+
+// Takes task back if nobody has started it yet. With strict fork-join
+// nesting it is at the back; the external deque is shared, so search it.
+inline bool ThreadPool::tryRemove(unsigned q, Task* task) {
+    std::lock_guard<std::mutex> guard(queues[q]->lock);
+    auto& tasks = queues[q]->tasks;
+    for (auto it = tasks.rbegin(); it != tasks.rend(); ++it) {
+        if (*it == task) {
+            tasks.erase(std::next(it).base());
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline ThreadPool::Task* ThreadPool::take(unsigned self) {
+    {
+        std::lock_guard<std::mutex> guard(queues[self]->lock);
+        auto& tasks = queues[self]->tasks;
+        if (!tasks.empty()) {
+            Task* task = tasks.back();
+            tasks.pop_back();
+            return task;
+        }
+    }
+    for (std::size_t i = 1; i < queues.size(); i++) {
+        Queue& victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            Task* task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+inline bool ThreadPool::runOne(unsigned self) {
+    Task* task = take(self);
+    if (!task) return false;
+
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    try {
+        task->call(task->arg);
+    }
+    catch (...) {
+        task->error = std::current_exception();
+    }
+    // the owner may return and destroy the task as soon as this is seen
+    task->done.store(true, std::memory_order_release);
+    return true;
+}
+
+// Waits for a stolen task, running others meanwhile. Never throws.
+inline void ThreadPool::join(unsigned q, Task* task) {
+    while (!task->done.load(std::memory_order_acquire)) {
+        if (!runOne(q))
+            std::this_thread::yield();
+    }
+}
+
+inline void ThreadPool::workerLoop(unsigned index) {
+    current() = Current{ this, index };
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (runOne(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepLock);
+        wake.wait(lock, [this] {
+            return stopping.load(std::memory_order_relaxed) || pending.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
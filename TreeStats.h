@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Instrumentation policies for the trees' Stats template parameter. The
+// trees report events through these hooks; NullStats compiles them away
+// and takes no space in the tree.
+
+struct NullStats {
+    void comparison(std::uint64_t = 1) const {}
+    void rotation() const {}
+    void split() const {}
+    void splay(int) const {}
+    void allocation() const {}
+    void deallocation() const {}
+    void depth(int) const {}
+};
+
+// Counts every event with relaxed atomics, so concurrent readers of a
+// shared tree can report without extra locking.
+//   comparisons   key comparisons on insert, remove and lookup paths,
+//                 counting a three-way decision at a node as one
+//   rotations     single rotations (a double rotation counts two)
+//   splits        BTree node splits
+//   splays        splay operations and the total depth they descended
+//   allocations   nodes allocated and freed; nodes moved in from another
+//                 tree by a join or set operation are not counted
+//   depth         histogram of lookup path lengths, the last bucket
+//                 collecting everything deeper
+class CountingStats {
+public:
+    static constexpr int histogramSize = 64;
+
+    CountingStats() { reset(); }
+    CountingStats(const CountingStats&) = delete;
+    CountingStats& operator=(const CountingStats&) = delete;
+
+    void comparison(std::uint64_t n = 1) const { comparisons_.fetch_add(n, std::memory_order_relaxed); }
+    void rotation() const { rotations_.fetch_add(1, std::memory_order_relaxed); }
+    void split() const { splits_.fetch_add(1, std::memory_order_relaxed); }
+
+    void splay(int depth) const {
+        splays_.fetch_add(1, std::memory_order_relaxed);
+        splayDepth_.fetch_add(static_cast<std::uint64_t>(depth), std::memory_order_relaxed);
+    }
+
+    void allocation() const { allocations_.fetch_add(1, std::memory_order_relaxed); }
+    void deallocation() const { deallocations_.fetch_add(1, std::memory_order_relaxed); }
+
+    void depth(int d) const {
+        int bucket = d < 0 ? 0 : (d >= histogramSize ? histogramSize - 1 : d);
+        histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t comparisons() const { return comparisons_.load(std::memory_order_relaxed); }
+    std::uint64_t rotations() const { return rotations_.load(std::memory_order_relaxed); }
+    std::uint64_t splits() const { return splits_.load(std::memory_order_relaxed); }
+    std::uint64_t splays() const { return splays_.load(std::memory_order_relaxed); }
+    std::uint64_t splayDepth() const { return splayDepth_.load(std::memory_order_relaxed); }
+    std::uint64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+    std::uint64_t deallocations() const { return deallocations_.load(std::memory_order_relaxed); }
+    std::uint64_t depthCount(int d) const { return histogram_[d].load(std::memory_order_relaxed); }
+
+    void reset() {
+        comparisons_.store(0, std::memory_order_relaxed);
+        rotations_.store(0, std::memory_order_relaxed);
+        splits_.store(0, std::memory_order_relaxed);
+        splays_.store(0, std::memory_order_relaxed);
+        splayDepth_.store(0, std::memory_order_relaxed);
+        allocations_.store(0, std::memory_order_relaxed);
+        deallocations_.store(0, std::memory_order_relaxed);
+        for (auto& bucket : histogram_)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    mutable std::atomic<std::uint64_t> comparisons_;
+    mutable std::atomic<std::uint64_t> rotations_;
+    mutable std::atomic<std::uint64_t> splits_;
+    mutable std::atomic<std::uint64_t> splays_;
+    mutable std::atomic<std::uint64_t> splayDepth_;
+    mutable std::atomic<std::uint64_t> allocations_;
+    mutable std::atomic<std::uint64_t> deallocations_;
+    mutable std::atomic<std::uint64_t> histogram_[histogramSize];
+};
+
+// Memory held by a tree's nodes: bytes requested from the allocator, and
+// how much of that is padding or unused key/child slots.
+struct MemoryFootprint {
+    std::size_t bytes;
+    std::size_t slack;
+};
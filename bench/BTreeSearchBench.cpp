@@ -0,0 +1,53 @@
+// In-node key search: the original linear scan against KeySearch, first on
+// bare node-sized arrays, then as full BTree lookups, for several degrees.
+#include "../BTree.h"
+#include "BenchUtil.h"
+#include <algorithm>
+#include <cstdio>
+
+static int linearLowerBound(const int* keys, int n, int k) {
+    int i = 0;
+    while (i < n && k > keys[i])
+        i++;
+    return i;
+}
+
+int main() {
+    const size_t lookups = 2000000;
+    const size_t treeKeys = 1000000;
+    std::vector<int> probes = uniformKeys(lookups, 7, 1 << 20);
+
+    std::printf("%6s %14s %14s %8s %16s\n", "t", "linear ns/op", "kernel ns/op", "speedup", "BTree ns/lookup");
+    for (int t : { 2, 4, 8, 16, 32, 64, 128, 256, 512 }) {
+        int n = 2 * t - 1;
+        std::vector<int> node = uniformKeys(n, t, 1 << 20);
+        std::sort(node.begin(), node.end());
+
+        Timer linear;
+        long long sum = 0;
+        for (int k : probes)
+            sum += linearLowerBound(node.data(), n, k);
+        double linearNs = linear.seconds() * 1e9 / lookups;
+        doNotOptimize(sum);
+
+        Timer kernel;
+        sum = 0;
+        for (int k : probes)
+            sum += KeySearch<int>::lowerBound(node.data(), n, k);
+        double kernelNs = kernel.seconds() * 1e9 / lookups;
+        doNotOptimize(sum);
+
+        BTree<int> tree(t);
+        for (int k : uniformKeys(treeKeys, 11, 1 << 20))
+            tree.insert(k);
+        Timer lookup;
+        size_t found = 0;
+        for (int k : probes)
+            found += tree.search(k);
+        double treeNs = lookup.seconds() * 1e9 / lookups;
+        doNotOptimize(found);
+
+        std::printf("%6d %14.2f %14.2f %7.2fx %16.2f\n", t, linearNs, kernelNs, linearNs / kernelNs, treeNs);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+class Timer {
+public:
+    Timer() : start(std::chrono::steady_clock::now()) {}
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+template<typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+inline std::vector<int> uniformKeys(size_t n, uint64_t seed, int range = 0x7fffffff) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> dist(0, range);
+    std::vector<int> keys(n);
+    for (auto& k : keys)
+        k = dist(rng);
+    return keys;
+}
+
+// n draws from universe distinct keys where the i-th most popular one has
+// probability proportional to 1 / (i + 1)^s. Ranks are drawn by
+// rejection-inversion (Hoermann and Derflinger, 1996), which needs O(1)
+// state instead of a table per key, so key sets of 10^8 and more do not
+// show up in the peak RSS of whatever is measured next. Popularity is
+// spread over [0, universe) by a fixed affine permutation, so hot keys are
+// not neighbours.
+inline std::vector<int> zipfKeys(size_t n, uint64_t seed, size_t universe, double s = 0.99) {
+    // (x^(1 - s) - 1) / (1 - s) and its inverse, written to stay accurate
+    // as s approaches 1
+    auto expm1x = [](double x) { return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x / 2 * (1 + x / 3 * (1 + x / 4)); };
+    auto log1px = [](double x) { return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - x / 4)); };
+    auto h = [&](double x) { return std::exp(-s * std::log(x)); };
+    auto hIntegral = [&](double x) { double lx = std::log(x); return expm1x((1 - s) * lx) * lx; };
+    auto hIntegralInverse = [&](double x) { return std::exp(log1px(std::max(x * (1 - s), -1.0)) * x); };
+
+    double top = hIntegral(1.5) - 1;
+    double bottom = hIntegral(static_cast<double>(universe) + 0.5);
+    double squeeze = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> dist(0, 1);
+    uint64_t scale = static_cast<uint64_t>(static_cast<double>(universe) * 0.6180339887) | 1;
+    while (std::gcd(scale, static_cast<uint64_t>(universe)) != 1)
+        scale += 2;
+    uint64_t shift = rng() % universe;
+
+    std::vector<int> keys(n);
+    for (auto& k : keys) {
+        uint64_t rank;
+        while (true) {
+            double u = bottom + dist(rng) * (top - bottom);
+            double x = hIntegralInverse(u);
+            double r = std::clamp(std::floor(x + 0.5), 1.0, static_cast<double>(universe));
+            if (r - x <= squeeze || u >= hIntegral(r + 0.5) - h(r)) {
+                rank = static_cast<uint64_t>(r) - 1;
+                break;
+            }
+        }
+        k = static_cast<int>((rank * scale + shift) % universe);
+    }
+    return keys;
+}
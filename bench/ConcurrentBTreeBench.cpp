@@ -0,0 +1,72 @@
+// Insert and lookup throughput against thread count: ConcurrentBTree versus
+// a BTree behind one global mutex.
+#include "../BTree.h"
+#include "../ConcurrentBTree.h"
+#include "BenchUtil.h"
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+template<typename Insert, typename Lookup>
+static void run(const char* name, int threads, const std::vector<int>& keys, Insert&& insert, Lookup&& lookup) {
+    size_t perThread = keys.size() / threads;
+    std::vector<std::thread> workers;
+
+    Timer insertTimer;
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            for (size_t i = w * perThread; i < (w + 1) * perThread; i++)
+                insert(keys[i]);
+        });
+    }
+    for (auto& th : workers)
+        th.join();
+    double insertSec = insertTimer.seconds();
+    workers.clear();
+
+    std::vector<size_t> found(threads);
+    Timer lookupTimer;
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            size_t hits = 0;
+            for (size_t i = w * perThread; i < (w + 1) * perThread; i++)
+                hits += lookup(keys[i]);
+            found[w] = hits;
+        });
+    }
+    for (auto& th : workers)
+        th.join();
+    double lookupSec = lookupTimer.seconds();
+    doNotOptimize(found);
+
+    double ops = static_cast<double>(perThread * threads);
+    std::printf("%-10s %8d %14.2f %14.2f\n", name, threads, ops / insertSec / 1e6, ops / lookupSec / 1e6);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+    int maxThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (maxThreads < 1) maxThreads = 1;
+    std::vector<int> keys = uniformKeys(n, 42);
+
+    std::printf("%-10s %8s %14s %14s\n", "tree", "threads", "insert Mops/s", "lookup Mops/s");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        {
+            BTree<int> tree(16);
+            std::mutex lock;
+            run("mutex", threads, keys,
+                [&](int k) { std::lock_guard<std::mutex> g(lock); tree.insert(k); },
+                [&](int k) { std::lock_guard<std::mutex> g(lock); return tree.search(k); });
+        }
+        {
+            ConcurrentBTree<int, 16> tree;
+            run("olc", threads, keys,
+                [&](int k) { tree.insert(k); },
+                [&](int k) { return tree.search(k); });
+        }
+        if (threads < maxThreads && threads * 2 > maxThreads)
+            threads = maxThreads / 2;
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// SplayTree's iterative top-down splay against the previous recursive
+// bottom-up version (kept below with parent links, as it was) on sorted,
+// uniform and Zipfian lookups. The bottom-up tree recurses once per level,
+// so the sorted case is limited to sizes its stack survives.
+#include "../SplayTree.h"
+#include "BenchUtil.h"
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+
+namespace legacy {
+
+template <typename T>
+class BottomUpSplayTree {
+private:
+    struct Node {
+        T key;
+        Node* left;
+        Node* right;
+        Node* parent;
+
+        Node(T k, Node* l = nullptr, Node* r = nullptr, Node* p = nullptr)
+            : key(k), left(l), right(r), parent(p) {}
+    };
+
+    Node* root = nullptr;
+
+    static void setParent(Node* child, Node* parent) {
+        if (child != nullptr)
+            child->parent = parent;
+    }
+
+    static void keepParent(Node* v) {
+        setParent(v->left, v);
+        setParent(v->right, v);
+    }
+
+    static void rotate(Node* parent, Node* child) {
+        Node* gparent = parent->parent;
+        if (gparent != nullptr) {
+            if (gparent->left == parent)
+                gparent->left = child;
+            else
+                gparent->right = child;
+        }
+        if (parent->left == child) {
+            parent->left = child->right;
+            child->right = parent;
+        }
+        else {
+            parent->right = child->left;
+            child->left = parent;
+        }
+        keepParent(child);
+        keepParent(parent);
+        child->parent = gparent;
+    }
+
+    static Node* splay(Node* v) {
+        if (v->parent == nullptr)
+            return v;
+        Node* parent = v->parent;
+        Node* gparent = parent->parent;
+        if (gparent == nullptr) {
+            rotate(parent, v);
+            return v;
+        }
+        bool zigzig = (gparent->left == parent) == (parent->left == v);
+        if (zigzig) {
+            rotate(gparent, parent);
+            rotate(parent, v);
+        }
+        else {
+            rotate(parent, v);
+            rotate(gparent, v);
+        }
+        return splay(v);
+    }
+
+    static Node* find(Node* v, T key) {
+        if (v == nullptr) return nullptr;
+        if (key == v->key) return splay(v);
+        if (key < v->key && v->left != nullptr) return find(v->left, key);
+        if (key > v->key && v->right != nullptr) return find(v->right, key);
+        return splay(v);
+    }
+
+    std::pair<Node*, Node*> split(Node* r, T key) {
+        if (r == nullptr)
+            return { nullptr, nullptr };
+        r = find(r, key);
+        if (r->key == key) {
+            Node* left = r->left;
+            Node* right = r->right;
+            setParent(left, nullptr);
+            setParent(right, nullptr);
+            delete r;
+            return { left, right };
+        }
+        if (r->key < key) {
+            Node* right = r->right;
+            r->right = nullptr;
+            setParent(right, nullptr);
+            return { r, right };
+        }
+        Node* left = r->left;
+        r->left = nullptr;
+        setParent(left, nullptr);
+        return { left, r };
+    }
+
+    static void clear(Node* node) {
+        while (node != nullptr) {
+            if (node->left != nullptr) {
+                Node* child = node->left;
+                node->left = child->right;
+                child->right = node;
+                node = child;
+            }
+            else {
+                Node* next = node->right;
+                delete node;
+                node = next;
+            }
+        }
+    }
+
+public:
+    BottomUpSplayTree() = default;
+    BottomUpSplayTree(const BottomUpSplayTree&) = delete;
+    BottomUpSplayTree& operator=(const BottomUpSplayTree&) = delete;
+    ~BottomUpSplayTree() { clear(root); }
+
+    void insert(T key) {
+        auto [left, right] = split(root, key);
+        root = new Node(key, left, right);
+        keepParent(root);
+    }
+
+    bool contains(T key) {
+        root = find(root, key);
+        return root != nullptr && root->key == key;
+    }
+};
+
+}
+
+template<typename Tree>
+static void run(const char* workload, const char* name, const std::vector<int>& inserts, const std::vector<int>& lookups) {
+    Tree tree;
+    Timer insertTimer;
+    for (int k : inserts)
+        tree.insert(k);
+    double insertSec = insertTimer.seconds();
+
+    Timer lookupTimer;
+    size_t found = 0;
+    for (int k : lookups)
+        found += tree.contains(k);
+    double lookupSec = lookupTimer.seconds();
+    doNotOptimize(found);
+
+    std::printf("%-8s %-10s %10zu %14.1f %14.1f\n", workload, name, inserts.size(),
+                insertSec * 1e9 / inserts.size(), lookupSec * 1e9 / lookups.size());
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    // deep enough for the sorted chain, shallow enough for the recursion
+    size_t sortedN = n < 20000 ? n : 20000;
+
+    std::vector<int> sorted(sortedN);
+    for (size_t i = 0; i < sortedN; i++)
+        sorted[i] = static_cast<int>(i);
+    std::vector<int> uniform = uniformKeys(n, 1, static_cast<int>(n));
+    std::vector<int> uniformProbe = uniformKeys(n, 2, static_cast<int>(n));
+    std::vector<int> zipfProbe = zipfKeys(n, 3, n);
+
+    std::printf("%-8s %-10s %10s %14s %14s\n", "workload", "splay", "keys", "insert ns/op", "lookup ns/op");
+    run<legacy::BottomUpSplayTree<int>>("sorted", "bottom-up", sorted, sorted);
+    run<SplayTree<int>>("sorted", "top-down", sorted, sorted);
+    run<legacy::BottomUpSplayTree<int>>("uniform", "bottom-up", uniform, uniformProbe);
+    run<SplayTree<int>>("uniform", "top-down", uniform, uniformProbe);
+    run<legacy::BottomUpSplayTree<int>>("zipf", "bottom-up", uniform, zipfProbe);
+    run<SplayTree<int>>("zipf", "top-down", uniform, zipfProbe);
+
+    std::vector<int> longChain(n);
+    for (size_t i = 0; i < n; i++)
+        longChain[i] = static_cast<int>(i);
+    run<SplayTree<int>>("sorted", "top-down", longChain, longChain);
+    return 0;
+}
@@ -0,0 +1,390 @@
+// Drives every tree through the same workloads and reports throughput,
+// per-operation latency percentiles, peak RSS and bytes per key.
+//
+//   treelib_bench [--sizes 1000,1000000] [--trees avl,rb,splay,btree,beps]
+//                 [--workloads uniform,sorted,reverse,zipf,mixed]
+//                 [--json results.json]
+//
+// Each run builds a tree from n distinct keys in the workload's order,
+// then runs a read phase and finally erases every key:
+//   uniform   random build, uniform lookups
+//   sorted    ascending build and lookups
+//   reverse   descending build and lookups
+//   zipf      random build, Zipf(0.99) lookups
+//   mixed     random build, then 90% Zipf lookups, 5% inserts, 5% erases
+// Sizes default to 10^3..10^6; larger ones (up to 10^8) have to be asked
+// for. Latency is sampled on one operation in 16 so the clock does not
+// dominate the throughput figure. Bytes per key counts what the tree asks
+// its allocator for, measured after the build.
+#include "../AVLTree.h"
+#include "../BEpsilonTree.h"
+#include "../BTree.h"
+#include "../RedBlackTree.h"
+#include "../SplayTree.h"
+#include "BenchUtil.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+static std::size_t liveBytes = 0;
+
+// std::allocator that keeps a running total of the bytes it hands out.
+template<typename T>
+class CountingAllocator {
+public:
+    using value_type = T;
+
+    CountingAllocator() noexcept = default;
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        liveBytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        liveBytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const CountingAllocator<U>&) const noexcept { return false; }
+};
+
+struct AvlAdapter {
+    static constexpr const char* name = "avl";
+    AVLTree<int, CountingAllocator<int>> tree;
+
+    void insert(int k) { tree.insert(k); }
+    bool find(int k) { return tree.search(k); }
+    void erase(int k) { tree.remove(k); }
+};
+
+struct RedBlackAdapter {
+    static constexpr const char* name = "rb";
+    RedBlackTree<int, int, ThreeWayCompare<int>, CountingAllocator<std::pair<const int, int>>> tree;
+
+    void insert(int k) { tree.insert(k, k); }
+    bool find(int k) { return tree.find(k) != tree.end(); }
+    void erase(int k) { tree.remove(k); }
+};
+
+struct SplayAdapter {
+    static constexpr const char* name = "splay";
+    SplayTree<int, CountingAllocator<int>> tree;
+
+    void insert(int k) { tree.insert(k); }
+    bool find(int k) { return tree.contains(k); }
+    void erase(int k) { tree.remove(k); }
+};
+
+struct BTreeAdapter {
+    static constexpr const char* name = "btree";
+    BTree<int, CountingAllocator<int>> tree{ 32 };
+
+    void insert(int k) { tree.insert(k); }
+    bool find(int k) { return tree.search(k); }
+    void erase(int k) { tree.remove(k); }
+};
+
+struct BEpsilonAdapter {
+    static constexpr const char* name = "beps";
+    BEpsilonTree<int, CountingAllocator<int>> tree;
+
+    void insert(int k) { tree.insert(k); }
+    bool find(int k) { return tree.search(k); }
+    void erase(int k) { tree.remove(k); }
+    void flush() { tree.flush(); }
+};
+
+// Applies updates an adapter still buffers, so an update phase is charged
+// for all of its work.
+template<typename Adapter>
+static void settle(Adapter& adapter) {
+    if constexpr (requires { adapter.flush(); })
+        adapter.flush();
+}
+
+// Peak resident set size since the last resetPeakRss(), in bytes.
+static void resetPeakRss() {
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+static std::size_t peakRss() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+struct Result {
+    std::string tree;
+    std::string workload;
+    std::size_t keys;
+    std::string phase;
+    std::size_t ops;
+    double mops;
+    double p50;
+    double p99;
+    double p999;
+    std::size_t rss;
+    double bytesPerKey;
+};
+
+// Times a phase of ops operations, sampling the latency of every 16th.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(std::size_t ops) { samples.reserve(ops / sampleEvery + 1); }
+
+    template<typename Op>
+    void run(std::size_t i, Op&& op) {
+        if (i % sampleEvery != 0) {
+            op();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        op();
+        samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    double seconds() const { return total.seconds(); }
+
+    double percentile(double p) {
+        if (samples.empty()) return 0;
+        std::size_t k = static_cast<std::size_t>(p * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+        return samples[k];
+    }
+
+private:
+    static constexpr std::size_t sampleEvery = 16;
+    Timer total;
+    std::vector<double> samples;
+};
+
+template<typename Adapter>
+static void runWorkload(const std::string& workload, std::size_t n, std::vector<Result>& results) {
+    // distinct even keys; odd ones stay free for inserts in the mixed phase
+    std::vector<int> keys(n);
+    for (std::size_t i = 0; i < n; i++)
+        keys[i] = static_cast<int>(2 * i);
+
+    std::mt19937_64 rng(n);
+    if (workload == "reverse")
+        std::reverse(keys.begin(), keys.end());
+    else if (workload != "sorted")
+        std::shuffle(keys.begin(), keys.end(), rng);
+
+    std::size_t readOps = std::min<std::size_t>(std::max<std::size_t>(n, 100000), 10000000);
+    std::vector<int> reads;
+    if (workload == "zipf" || workload == "mixed") {
+        for (int rank : zipfKeys(readOps, n + 1, n))
+            reads.push_back(keys[rank]);
+    }
+    else if (workload == "uniform") {
+        std::uniform_int_distribution<std::size_t> pick(0, n - 1);
+        reads.resize(readOps);
+        for (auto& k : reads)
+            k = keys[pick(rng)];
+    }
+    else {
+        reads.resize(readOps);
+        for (std::size_t i = 0; i < readOps; i++)
+            reads[i] = keys[i % n];
+    }
+
+    resetPeakRss();
+    std::size_t baseBytes = liveBytes;
+    auto adapter = std::make_unique<Adapter>();
+    auto record = [&](const char* phase, std::size_t ops, PhaseTimer& timer, double bytesPerKey) {
+        double sec = timer.seconds();
+        results.push_back({ Adapter::name, workload, n, phase, ops, ops / sec / 1e6,
+                            timer.percentile(0.5), timer.percentile(0.99), timer.percentile(0.999),
+                            peakRss(), bytesPerKey });
+    };
+
+    {
+        PhaseTimer timer(n);
+        for (std::size_t i = 0; i < n; i++)
+            timer.run(i, [&] { adapter->insert(keys[i]); });
+        settle(*adapter);
+        record("insert", n, timer, static_cast<double>(liveBytes - baseBytes) / n);
+    }
+
+    std::size_t found = 0;
+    if (workload == "mixed") {
+        std::vector<int> present = keys;
+        int fresh = 1;
+        std::uniform_int_distribution<int> choice(0, 99);
+        PhaseTimer timer(readOps);
+        for (std::size_t i = 0; i < readOps; i++) {
+            int c = choice(rng);
+            if (c < 90) {
+                timer.run(i, [&] { found += adapter->find(reads[i]); });
+            }
+            else if (c < 95 || present.empty()) {
+                timer.run(i, [&] { adapter->insert(fresh); });
+                present.push_back(fresh);
+                fresh += 2;
+            }
+            else {
+                std::size_t j = rng() % present.size();
+                timer.run(i, [&] { adapter->erase(present[j]); });
+                present[j] = present.back();
+                present.pop_back();
+            }
+        }
+        settle(*adapter);
+        record("mixed", readOps, timer, 0);
+        keys = std::move(present);
+    }
+    else {
+        PhaseTimer timer(readOps);
+        for (std::size_t i = 0; i < readOps; i++)
+            timer.run(i, [&] { found += adapter->find(reads[i]); });
+        record("lookup", readOps, timer, 0);
+    }
+    doNotOptimize(found);
+
+    {
+        if (workload != "sorted" && workload != "reverse")
+            std::shuffle(keys.begin(), keys.end(), rng);
+        PhaseTimer timer(keys.size());
+        for (std::size_t i = 0; i < keys.size(); i++)
+            timer.run(i, [&] { adapter->erase(keys[i]); });
+        settle(*adapter);
+        record("erase", keys.size(), timer, 0);
+    }
+}
+
+static std::vector<std::string> splitList(const char* arg) {
+    std::vector<std::string> items;
+    std::stringstream in(arg);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+// Rejects names that are not in known, so a typo is not silently skipped
+static bool checkNames(const std::vector<std::string>& names, const std::vector<std::string>& known, const char* what) {
+    for (const std::string& name : names) {
+        if (std::find(known.begin(), known.end(), name) == known.end()) {
+            std::string list;
+            for (const std::string& k : known)
+                list += (list.empty() ? "" : ",") + k;
+            std::fprintf(stderr, "unknown %s '%s' (expected %s)\n", what, name.c_str(), list.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static void writeJson(const char* path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "[\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "  {\"tree\": \"" << r.tree << "\", \"workload\": \"" << r.workload
+            << "\", \"keys\": " << r.keys << ", \"phase\": \"" << r.phase
+            << "\", \"ops\": " << r.ops << ", \"mops\": " << r.mops
+            << ", \"p50_ns\": " << r.p50 << ", \"p99_ns\": " << r.p99 << ", \"p999_ns\": " << r.p999
+            << ", \"peak_rss_bytes\": " << r.rss << ", \"bytes_per_key\": " << r.bytesPerKey << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes = { 1000, 10000, 100000, 1000000 };
+    const std::vector<std::string> allTrees = { "avl", "rb", "splay", "btree", "beps" };
+    const std::vector<std::string> allWorkloads = { "uniform", "sorted", "reverse", "zipf", "mixed" };
+    std::vector<std::string> trees = allTrees;
+    std::vector<std::string> workloads = allWorkloads;
+    const char* jsonPath = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--sizes") == 0 && hasValue) {
+            sizes.clear();
+            for (const std::string& s : splitList(argv[++i]))
+                sizes.push_back(static_cast<std::size_t>(std::strtod(s.c_str(), nullptr)));
+        }
+        else if (std::strcmp(argv[i], "--trees") == 0 && hasValue) {
+            trees = splitList(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--workloads") == 0 && hasValue) {
+            workloads = splitList(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--json") == 0 && hasValue) {
+            jsonPath = argv[++i];
+        }
+        else {
+            std::fprintf(stderr, "usage: %s [--sizes n,...] [--trees avl,rb,splay,btree,beps] "
+                                 "[--workloads uniform,sorted,reverse,zipf,mixed] [--json file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!checkNames(trees, allTrees, "tree") || !checkNames(workloads, allWorkloads, "workload"))
+        return 1;
+
+    std::vector<Result> results;
+    std::printf("%-6s %-8s %10s %-7s %9s %9s %9s %9s %9s %10s\n",
+                "tree", "workload", "keys", "phase", "Mops/s", "p50 ns", "p99 ns", "p999 ns", "RSS MiB", "bytes/key");
+    for (std::size_t n : sizes) {
+        if (n == 0) continue;
+        for (const std::string& workload : workloads) {
+            for (const std::string& tree : trees) {
+                std::size_t first = results.size();
+                if (tree == "avl") runWorkload<AvlAdapter>(workload, n, results);
+                else if (tree == "rb") runWorkload<RedBlackAdapter>(workload, n, results);
+                else if (tree == "splay") runWorkload<SplayAdapter>(workload, n, results);
+                else if (tree == "btree") runWorkload<BTreeAdapter>(workload, n, results);
+                else if (tree == "beps") runWorkload<BEpsilonAdapter>(workload, n, results);
+
+                for (std::size_t i = first; i < results.size(); i++) {
+                    const Result& r = results[i];
+                    std::printf("%-6s %-8s %10zu %-7s %9.2f %9.0f %9.0f %9.0f %9.1f %10.1f\n",
+                                r.tree.c_str(), r.workload.c_str(), r.keys, r.phase.c_str(), r.mops,
+                                r.p50, r.p99, r.p999, r.rss / 1048576.0, r.bytesPerKey);
+                }
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    if (jsonPath)
+        writeJson(jsonPath, results);
+    return 0;
+}
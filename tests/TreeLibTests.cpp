@@ -0,0 +1,704 @@
+// Differential tests: every structure runs a random sequence of operations
+// next to std::set, std::multiset or std::map, checking lookups as it goes
+// and the full contents every 1000 steps. Every header is included, so this
+// also keeps the whole library compiling.
+//
+//   treelib_tests [name ...]
+#include "../AVLTree.h"
+#include "../Allocator.h"
+#include "../Augment.h"
+#include "../BEpsilonTree.h"
+#include "../BPlusTree.h"
+#include "../BTree.h"
+#include "../BTreeMap.h"
+#include "../ConcurrentBTree.h"
+#include "../DiskBTree.h"
+#include "../ITree.h"
+#include "../InlineBTree.h"
+#include "../IntervalTree.h"
+#include "../KeySearch.h"
+#include "../PersistentAVLTree.h"
+#include "../RedBlackTree.h"
+#include "../ShardedTree.h"
+#include "../SharedSplayTree.h"
+#include "../Snapshot.h"
+#include "../SplayCache.h"
+#include "../SplayTree.h"
+#include "../StaticSearchTree.h"
+#include "../ThreadPool.h"
+#include "../TreeStats.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                   \
+    do {                                                                              \
+        if (!(cond)) {                                                                \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                               \
+        }                                                                             \
+    } while (0)
+
+static constexpr int steps = 20000;
+static constexpr int keyRange = 2000;
+
+template<typename K>
+static std::vector<K> frozenKeys(const StaticSearchTree<K>& frozen) {
+    return std::vector<K>(frozen.begin(), frozen.begin() + frozen.size());
+}
+
+template<typename Container>
+static std::vector<int> sorted(const Container& c) {
+    return std::vector<int>(c.begin(), c.end());
+}
+
+// Drives an ITree<int> through inserts, removes and searches against Ref
+// (std::set or std::multiset), calling check(tree, ref) every 1000 steps.
+template<typename Tree, typename Ref, typename Check>
+static void differential(Tree& tree, Ref& ref, unsigned seed, Check&& check) {
+    std::mt19937 rng(seed);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % keyRange);
+        switch (rng() % 4) {
+        case 0:
+        case 1:
+            tree.insert(key);
+            ref.insert(key);
+            break;
+        case 2:
+            tree.remove(key);
+            if (auto it = ref.find(key); it != ref.end())
+                ref.erase(it);
+            break;
+        default:
+            CHECK(tree.search(key) == (ref.count(key) != 0));
+            break;
+        }
+        if (step % 1000 == 999)
+            check(tree, ref);
+    }
+    check(tree, ref);
+}
+
+static void testAvl() {
+    AVLTree<int, std::allocator<int>, NullStats, SumAugment<int>> tree;
+    std::set<int> ref;
+    differential(tree, ref, 1, [](auto& t, auto& r) {
+        CHECK(frozenKeys(t.freeze()) == sorted(r));
+        CHECK(t.size() == r.size());
+        CHECK(t.verify());
+    });
+
+    std::mt19937 rng(2);
+    for (int i = 0; i < 200; i++) {
+        int lo = static_cast<int>(rng() % keyRange), hi = lo + static_cast<int>(rng() % 200);
+        auto first = ref.lower_bound(lo), last = ref.upper_bound(hi);
+        int sum = 0;
+        for (auto it = first; it != last; ++it)
+            sum += *it;
+        CHECK(tree.count_range(lo, hi) == static_cast<std::size_t>(std::distance(first, last)));
+        CHECK(tree.aggregate(lo, hi) == sum);
+        CHECK(tree.rank(lo) == static_cast<std::size_t>(std::distance(ref.begin(), first)));
+        if (first != ref.end())
+            CHECK(tree.select(tree.rank(lo)) && *tree.select(tree.rank(lo)) == *first);
+    }
+    CHECK(tree.select(ref.size()) == nullptr);
+
+    ThreadPool pool(2);
+    std::vector<int> batch;
+    for (int i = 0; i < 5000; i++)
+        batch.push_back(static_cast<int>(rng() % (2 * keyRange)));
+    tree.insert_batch(batch.begin(), batch.end(), &pool);
+    ref.insert(batch.begin(), batch.end());
+    CHECK(frozenKeys(tree.freeze()) == sorted(ref));
+    CHECK(tree.verify());
+
+    using Set = AVLTree<int, std::allocator<int>, NullStats, SumAugment<int>>;
+    for (int i = 0; i < 50; i++) {
+        int key = static_cast<int>(rng() % (2 * keyRange));
+        Set right;
+        tree.split(key, right);
+        CHECK(tree.verify());
+        CHECK(right.verify());
+        CHECK(tree.size() == static_cast<std::size_t>(std::distance(ref.begin(), ref.upper_bound(key))));
+        tree.join(right);
+        CHECK(tree.verify());
+        CHECK(right.size() == 0);
+    }
+    CHECK(frozenKeys(tree.freeze()) == sorted(ref));
+
+    auto setOp = [&](void (Set::*op)(Set&, ThreadPool&), auto&& expected) {
+        Set a, b;
+        std::set<int> ra, rb;
+        for (int i = 0; i < 3000; i++) {
+            int x = static_cast<int>(rng() % keyRange), y = static_cast<int>(rng() % keyRange);
+            a.insert(x), ra.insert(x);
+            b.insert(y), rb.insert(y);
+        }
+        (a.*op)(b, pool);
+        CHECK(a.verify());
+        std::vector<int> want;
+        expected(ra.begin(), ra.end(), rb.begin(), rb.end(), std::back_inserter(want));
+        CHECK(frozenKeys(a.freeze()) == want);
+        CHECK(b.size() == 0);
+    };
+    setOp(&Set::unite_with, [](auto... args) { std::set_union(args...); });
+    setOp(&Set::intersect_with, [](auto... args) { std::set_intersection(args...); });
+    setOp(&Set::difference_with, [](auto... args) { std::set_difference(args...); });
+
+    std::stringstream buffer;
+    CHECK(tree.save(buffer));
+    Set loaded;
+    CHECK(loaded.load(buffer));
+    CHECK(frozenKeys(loaded.freeze()) == sorted(ref));
+
+    AVLTree<int, PoolAllocator<int>> pooled;
+    std::set<int> pooledRef;
+    differential(pooled, pooledRef, 20, [](auto& t, auto& r) { CHECK(frozenKeys(t.freeze()) == sorted(r)); });
+}
+
+static void testRedBlack() {
+    RedBlackTree<int, int> tree;
+    std::multiset<int> ref;
+    std::mt19937 rng(3);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % keyRange);
+        switch (rng() % 4) {
+        case 0:
+        case 1:
+            tree.insert(key, -key);
+            ref.insert(key);
+            break;
+        case 2: {
+            auto it = ref.find(key);
+            CHECK(tree.remove(key) == (it != ref.end()));
+            if (it != ref.end())
+                ref.erase(it);
+            break;
+        }
+        default: {
+            int value = 0;
+            bool found = tree.search(key, value);
+            CHECK(found == (ref.count(key) != 0));
+            CHECK(!found || value == -key);
+            auto lower = tree.lower_bound(key);
+            auto want = ref.lower_bound(key);
+            CHECK((lower == tree.end()) == (want == ref.end()));
+            if (lower != tree.end() && want != ref.end())
+                CHECK(lower->first == *want);
+            break;
+        }
+        }
+        if (step % 1000 == 999)
+            CHECK(tree.verify());
+    }
+    std::vector<int> keys;
+    for (const auto& entry : tree)
+        keys.push_back(entry.first);
+    CHECK(keys == sorted(ref));
+    CHECK(static_cast<std::size_t>(tree.getSize()) == ref.size());
+
+    // a sorted batch, then one in random order, both with duplicates
+    std::vector<std::pair<int, int>> batch;
+    for (int i = 0; i < 3000; i++)
+        batch.emplace_back(i / 2, -(i / 2));
+    for (int round = 0; round < 2; round++) {
+        tree.insert_batch(batch.begin(), batch.end());
+        for (const auto& entry : batch)
+            ref.insert(entry.first);
+        CHECK(tree.verify());
+        std::shuffle(batch.begin(), batch.end(), rng);
+    }
+    keys.clear();
+    for (const auto& entry : tree)
+        keys.push_back(entry.first);
+    CHECK(keys == sorted(ref));
+}
+
+static void testSplay() {
+    SplayTree<int, PoolAllocator<int>> tree;
+    std::set<int> ref;
+    differential(tree, ref, 4, [](auto& t, auto& r) { CHECK(frozenKeys(t.freeze()) == sorted(r)); });
+}
+
+static void testBTree() {
+    BTree<int, std::allocator<int>, CountingStats> tree(3);
+    std::multiset<int> ref;
+    differential(tree, ref, 5, [](auto& t, auto& r) {
+        CHECK(frozenKeys(t.freeze()) == sorted(r));
+        CHECK(t.verify());
+    });
+
+    tree.erase_range(100, 900);
+    ref.erase(ref.lower_bound(100), ref.upper_bound(900));
+    CHECK(frozenKeys(tree.freeze()) == sorted(ref));
+    CHECK(tree.verify());
+
+    // random ranges, at the smallest degrees, over keys repeated many times
+    std::mt19937 rng(22);
+    for (int degree = 2; degree <= 4; degree++) {
+        BTree<int> small(degree);
+        std::multiset<int> smallRef;
+        for (int round = 0; round < 100; round++) {
+            for (int i = 0; i < 100; i++) {
+                int key = static_cast<int>(rng() % 300);
+                small.insert(key);
+                smallRef.insert(key);
+            }
+            int lo = static_cast<int>(rng() % 300), hi = lo + static_cast<int>(rng() % 60);
+            small.erase_range(lo, hi);
+            smallRef.erase(smallRef.lower_bound(lo), smallRef.upper_bound(hi));
+            CHECK(small.verify());
+            CHECK(frozenKeys(small.freeze()) == sorted(smallRef));
+        }
+    }
+
+    std::vector<int> keys = sorted(ref);
+    BTree<int> loaded(4);
+    loaded.bulk_load(keys.begin(), keys.end(), 0.7);
+    CHECK(frozenKeys(loaded.freeze()) == keys);
+    CHECK(loaded.verify());
+    for (int key = 0; key < keyRange; key++)
+        CHECK(loaded.search(key) == (ref.count(key) != 0));
+}
+
+static void testBPlus() {
+    BPlusTree<int> tree(3);
+    std::multiset<int> ref;
+    differential(tree, ref, 6, [](auto& t, auto& r) {
+        CHECK(sorted(t) == sorted(r));
+        CHECK(t.size() == r.size());
+    });
+
+    std::mt19937 rng(7);
+    for (int i = 0; i < 200; i++) {
+        int lo = static_cast<int>(rng() % keyRange), hi = lo + static_cast<int>(rng() % 200);
+        std::vector<int> got;
+        tree.scan(lo, hi, [&](int key) { got.push_back(key); });
+        CHECK(got == std::vector<int>(ref.lower_bound(lo), ref.upper_bound(hi)));
+        auto upper = tree.upper_bound(lo);
+        CHECK((upper == tree.end()) == (ref.upper_bound(lo) == ref.end()));
+    }
+}
+
+static void testBEpsilon() {
+    // tiny nodes so buffers flush and nodes split constantly
+    BEpsilonTree<int> tree(4, 8, 4);
+    std::set<int> ref;
+    differential(tree, ref, 8, [](auto& t, auto& r) { CHECK(frozenKeys(t.freeze()) == sorted(r)); });
+    tree.flush();
+    CHECK(frozenKeys(tree.freeze()) == sorted(ref));
+
+    // wide nodes, so runs reaching a buffer (first) or a leaf (second) can
+    // be short enough next to it to be placed by searching
+    const int shapes[][3] = { { 32, 64, 4 }, { 32, 64, 64 } };
+    for (const auto& shape : shapes) {
+        BEpsilonTree<int> wide(shape[0], shape[1], shape[2]);
+        std::set<int> wideRef;
+        differential(wide, wideRef, 21, [](auto& t, auto& r) { CHECK(frozenKeys(t.freeze()) == sorted(r)); });
+        wide.flush();
+        CHECK(frozenKeys(wide.freeze()) == sorted(wideRef));
+    }
+}
+
+static void testInlineBTree() {
+    InlineBTree<int> tree;
+    std::set<int> ref;
+    std::mt19937 rng(9);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % (4 * keyRange));
+        if (rng() % 2) {
+            tree.insert(key);
+            ref.insert(key);
+        }
+        else {
+            CHECK((tree.search(key) != nullptr) == (ref.count(key) != 0));
+        }
+    }
+}
+
+static void testConcurrentBTree() {
+    ConcurrentBTree<int, 4> tree;
+    const int threads = 4, perThread = 5000;
+    std::vector<std::thread> workers;
+    for (int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w] {
+            for (int i = 0; i < perThread; i++) {
+                tree.insert(i * threads + w);
+                CHECK(tree.search(i * threads + w));
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+
+    std::stringstream out;
+    tree.traverse(out);
+    std::vector<int> keys{ std::istream_iterator<int>(out), std::istream_iterator<int>() };
+    CHECK(static_cast<int>(keys.size()) == threads * perThread);
+    for (int i = 0; i < static_cast<int>(keys.size()); i++)
+        CHECK(keys[i] == i);
+    CHECK(!tree.search(-1));
+}
+
+static void testPersistentAvl() {
+    PersistentAVLTree<int> tree;
+    std::set<int> ref;
+    auto contents = [](const PersistentAVLTree<int>::Snapshot& snapshot) {
+        std::vector<int> keys;
+        snapshot.for_each([&](int key) { keys.push_back(key); });
+        return keys;
+    };
+
+    std::vector<std::pair<PersistentAVLTree<int>::Snapshot, std::vector<int>>> versions;
+    differential(tree, ref, 10, [&](auto& t, auto& r) {
+        auto snapshot = t.snapshot();
+        CHECK(contents(snapshot) == sorted(r));
+        versions.emplace_back(snapshot, sorted(r));
+    });
+    // older versions are unchanged by everything that came after them
+    for (const auto& [snapshot, keys] : versions)
+        CHECK(contents(snapshot) == keys);
+
+    auto snapshot = tree.snapshot();
+    std::mt19937 rng(11);
+    for (int i = 0; i < 200; i++) {
+        int lo = static_cast<int>(rng() % keyRange), hi = lo + static_cast<int>(rng() % 200);
+        auto first = ref.lower_bound(lo);
+        CHECK(snapshot.rank(lo) == static_cast<std::size_t>(std::distance(ref.begin(), first)));
+        CHECK(snapshot.count_range(lo, hi) == static_cast<std::size_t>(std::distance(first, ref.upper_bound(hi))));
+        if (first != ref.end())
+            CHECK(*snapshot.select(snapshot.rank(lo)) == *first);
+    }
+}
+
+static void testSharded() {
+    ShardedTree<AVLTree<int>, int> tree({ keyRange / 2 });
+    tree.setSplitPolicy(500, 32, 64);
+    std::set<int> ref;
+    differential(tree, ref, 12, [](auto& t, auto& r) {
+        std::vector<int> keys;
+        t.for_each([&](int key) { keys.push_back(key); });
+        CHECK(keys == sorted(r));
+        CHECK(t.size() == r.size());
+    });
+    CHECK(tree.shard_count() > 2);
+
+    std::mt19937 rng(13);
+    for (int i = 0; i < 200; i++) {
+        int lo = static_cast<int>(rng() % keyRange), hi = lo + static_cast<int>(rng() % 400);
+        std::vector<int> got;
+        tree.for_each_range(lo, hi, [&](int key) { got.push_back(key); });
+        CHECK(got == std::vector<int>(ref.lower_bound(lo), ref.upper_bound(hi)));
+    }
+}
+
+static void testBTreeMap() {
+    BTreeMap<int, int> map;
+    std::map<int, int> ref;
+    std::mt19937 rng(14);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % keyRange) - keyRange / 2;
+        switch (rng() % 4) {
+        case 0:
+        case 1:
+            CHECK(map.insert(key, step) == ref.emplace(key, step).second);
+            break;
+        case 2:
+            CHECK(map.remove(key) == (ref.erase(key) != 0));
+            break;
+        default: {
+            int value = 0;
+            auto it = ref.find(key);
+            CHECK(map.find(key, value) == (it != ref.end()));
+            CHECK(it == ref.end() || value == it->second);
+            break;
+        }
+        }
+    }
+    CHECK(map.size() == ref.size());
+    std::vector<std::pair<int, int>> entries;
+    map.for_each([&](int key, int value) { entries.emplace_back(key, value); });
+    std::vector<std::pair<int, int>> wantEntries(ref.begin(), ref.end());
+    CHECK(entries == wantEntries);
+
+    BTreeMap<std::string, std::string> strings;
+    std::map<std::string, std::string> stringRef;
+    for (int step = 0; step < steps; step++) {
+        std::string key = "key/" + std::to_string(rng() % keyRange) + std::string(rng() % 24, 'x');
+        if (rng() % 3) {
+            CHECK(strings.insert(key, key + "=value") == stringRef.emplace(key, key + "=value").second);
+        }
+        else {
+            CHECK(strings.remove(key) == (stringRef.erase(key) != 0));
+        }
+    }
+    std::vector<std::pair<std::string, std::string>> stringEntries;
+    strings.for_each_range("key/1", "key/5", [&](const std::string& key, const std::string& value) {
+        stringEntries.emplace_back(key, value);
+    });
+    std::vector<std::pair<std::string, std::string>> wantStrings(stringRef.lower_bound("key/1"), stringRef.upper_bound("key/5"));
+    CHECK(stringEntries == wantStrings);
+}
+
+static void testInterval() {
+    IntervalTree<int, int> tree;
+    std::multiset<std::pair<int, int>> ref;
+    std::mt19937 rng(15);
+    auto overlapping = [&](int lo, int hi) {
+        std::multiset<std::pair<int, int>> want;
+        for (const auto& [a, b] : ref)
+            if (a <= hi && lo <= b)
+                want.emplace(a, b);
+        return want;
+    };
+
+    CHECK(!tree.insert(5, 4, 0));
+    for (int step = 0; step < steps / 4; step++) {
+        int lo = static_cast<int>(rng() % keyRange), hi = lo + static_cast<int>(rng() % 50);
+        switch (rng() % 4) {
+        case 0:
+        case 1:
+            CHECK(tree.insert(lo, hi, lo ^ hi));
+            ref.emplace(lo, hi);
+            break;
+        case 2: {
+            auto it = ref.find({ lo, hi });
+            CHECK(tree.remove(lo, hi) == (it != ref.end()));
+            if (it != ref.end())
+                ref.erase(it);
+            break;
+        }
+        default: {
+            std::multiset<std::pair<int, int>> got;
+            tree.overlapping(lo, hi, [&](int a, int b, int value) {
+                CHECK(value == (a ^ b));
+                got.emplace(a, b);
+            });
+            CHECK(got == overlapping(lo, hi));
+            CHECK(tree.overlaps(lo, hi) == !got.empty());
+            break;
+        }
+        }
+    }
+    CHECK(tree.size() == ref.size());
+}
+
+static void testSplayCache() {
+    SplayCache<int, int> unbounded(0);
+    std::map<int, int> ref;
+    std::mt19937 rng(16);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % keyRange);
+        switch (rng() % 3) {
+        case 0:
+            unbounded.put(key, step);
+            ref[key] = step;
+            break;
+        case 1:
+            CHECK(unbounded.erase(key) == (ref.erase(key) != 0));
+            break;
+        default: {
+            int* value = unbounded.get(key);
+            auto it = ref.find(key);
+            CHECK((value != nullptr) == (it != ref.end()));
+            CHECK(!value || *value == it->second);
+            break;
+        }
+        }
+    }
+    CHECK(unbounded.size() == ref.size());
+
+    // a bounded cache may drop entries, but never returns a stale value
+    SplayCache<int, int> bounded(64);
+    std::map<int, int> latest;
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % 256);
+        if (rng() % 2) {
+            bounded.put(key, step);
+            latest[key] = step;
+        }
+        else if (int* value = bounded.get(key)) {
+            CHECK(*value == latest[key]);
+        }
+        CHECK(bounded.size() <= 64);
+    }
+}
+
+static void testSharedSplay() {
+    SharedSplayTree<int> tree(4, 8);
+    std::set<int> ref;
+    std::mt19937 rng(17);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(rng() % keyRange);
+        switch (rng() % 3) {
+        case 0:
+            tree.insert(key);
+            ref.insert(key);
+            break;
+        case 1:
+            tree.remove(key);
+            ref.erase(key);
+            break;
+        default:
+            CHECK(tree.contains(key) == (ref.count(key) != 0));
+            break;
+        }
+    }
+}
+
+static void testDiskBTree() {
+    std::string path = (std::filesystem::temp_directory_path() / "treelib_tests.db").string();
+    std::filesystem::remove(path);
+    std::set<int> ref;
+    std::mt19937 rng(18);
+    {
+        // 16 frames of 512 bytes, so most inserts evict a dirty page
+        DiskBTree<int> tree(path, 0, 512);
+        CHECK(tree.isOpen());
+        for (int step = 0; step < steps; step++) {
+            int key = static_cast<int>(rng() % (8 * keyRange));
+            if (ref.insert(key).second)
+                CHECK(tree.insert(key));
+            else
+                CHECK(tree.search(key));
+        }
+        CHECK(tree.flush());
+    }
+    {
+        DiskBTree<int> tree(path, 0, 512);
+        CHECK(tree.isOpen());
+        CHECK(tree.size() == ref.size());
+        for (int key = -1; key <= 8 * keyRange; key++)
+            CHECK(tree.search(key) == (ref.count(key) != 0));
+    }
+    {
+        // a header for another page size is refused
+        DiskBTree<int> tree(path, 0, 1024);
+        CHECK(!tree.isOpen());
+    }
+    std::filesystem::remove(path);
+}
+
+static void testStaticSearchTree() {
+    std::mt19937 rng(19);
+    std::vector<int> keys;
+    for (int i = 0; i < 5000; i++)
+        keys.push_back(static_cast<int>(rng() % keyRange));
+    std::sort(keys.begin(), keys.end());
+    StaticSearchTree<int> tree(keys);
+    CHECK(tree.size() == keys.size());
+    for (int key = -1; key <= keyRange; key++) {
+        auto lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        auto upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+        CHECK(tree.lower_bound(key) == static_cast<std::size_t>(lower));
+        CHECK(tree.upper_bound(key) == static_cast<std::size_t>(upper));
+        CHECK(tree.contains(key) == (lower != upper));
+        CHECK(tree.count_range(key, key + 10)
+              == static_cast<std::size_t>(std::upper_bound(keys.begin(), keys.end(), key + 10) - keys.begin() - lower));
+    }
+
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<int> values;
+    for (int key : keys)
+        values.push_back(key * 3);
+    StaticSearchTree<int, int> map(keys, values);
+    for (int key = -1; key <= keyRange; key++) {
+        const int* value = map.find(key);
+        CHECK((value != nullptr) == std::binary_search(keys.begin(), keys.end(), key));
+        CHECK(!value || *value == key * 3);
+    }
+}
+
+static long fib(ThreadPool& pool, int n) {
+    if (n < 12)
+        return n < 2 ? n : fib(pool, n - 1) + fib(pool, n - 2);
+    long a = 0, b = 0;
+    pool.invoke([&] { a = fib(pool, n - 1); }, [&] { b = fib(pool, n - 2); });
+    return a + b;
+}
+
+static void testThreadPool() {
+    ThreadPool pool(4);
+    CHECK(fib(pool, 24) == 46368);
+
+    bool caught = false;
+    try {
+        pool.invoke([] {}, [] { throw std::runtime_error("b"); });
+    }
+    catch (const std::runtime_error&) {
+        caught = true;
+    }
+    CHECK(caught);
+
+    caught = false;
+    try {
+        pool.invoke([] { throw std::runtime_error("a"); }, [] {});
+    }
+    catch (const std::runtime_error&) {
+        caught = true;
+    }
+    CHECK(caught);
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+static const TestCase tests[] = {
+    { "avl", testAvl },
+    { "rb", testRedBlack },
+    { "splay", testSplay },
+    { "btree", testBTree },
+    { "bplus", testBPlus },
+    { "beps", testBEpsilon },
+    { "inline", testInlineBTree },
+    { "concurrent", testConcurrentBTree },
+    { "persistent", testPersistentAvl },
+    { "sharded", testSharded },
+    { "btreemap", testBTreeMap },
+    { "interval", testInterval },
+    { "splaycache", testSplayCache },
+    { "sharedsplay", testSharedSplay },
+    { "disk", testDiskBTree },
+    { "static", testStaticSearchTree },
+    { "threadpool", testThreadPool },
+};
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        bool known = std::any_of(std::begin(tests), std::end(tests),
+                                 [&](const TestCase& test) { return std::strcmp(test.name, argv[i]) == 0; });
+        if (!known) {
+            std::fprintf(stderr, "unknown test '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    for (const TestCase& test : tests) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; i++)
+            selected = selected || std::strcmp(test.name, argv[i]) == 0;
+        if (!selected)
+            continue;
+
+        int before = failures;
+        test.run();
+        std::printf("%-12s %s\n", test.name, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}